@@ -0,0 +1,457 @@
+/**
+ * @file bench.h
+ * @brief Workload replay benchmark. Generates a deterministic stream of commands, runs each
+ * of them through run() and reports throughput and latency percentiles per command type.
+ * Built by "make bench", which compiles project.c with BENCH defined.
+ */
+
+#ifndef _BENCH__H_
+#define _BENCH__H_
+
+#include <math.h>
+
+#define BENCH_STUDENTS 100000       // Default number of Students added before the mix
+#define BENCH_COMMANDS 200000       // Default number of commands in the mix
+#define BENCH_MIX "1000:8990:4:3:3" // Default A:U:L:W:O weights of the mix
+#define BENCH_SKEW 1.0              // Default update skew, 1.0 is uniform
+#define BENCH_NAME_MIN 3            // Default shortest generated name
+#define BENCH_NAME_MAX 12           // Default longest generated name
+#define BENCH_SEED 1                // Default generator seed
+#define BENCH_FILE "bench_db.txt"   // Default file written by W and loaded by O
+#define BENCH_CMND_TYPES 5          // A, U, L, W, O
+
+#ifndef _WIN32
+#define BENCH_NULL_DEVICE "/dev/null"
+#else
+#define BENCH_NULL_DEVICE "NUL"
+#endif
+
+/**
+ * @brief Settings of one benchmark run.
+ *
+ * @param students number of Students added before the mix
+ * @param commands number of commands in the mix
+ * @param weights relative weights of A, U, L, W and O in the mix
+ * @param skew update skew: student i of n is picked as n * u^skew for a uniform u, so 1.0
+ * picks uniformly and larger values concentrate updates on the first Students
+ * @param name_min shortest generated name
+ * @param name_max longest generated name
+ * @param seed generator seed, equal settings give equal workloads
+ * @param filename file written by W and loaded by O
+ * @param lazy TRUE to run with lazy ordering
+ * @param workers number of worker threads, 0 for the default
+ */
+typedef struct {
+	int students;
+	int commands;
+	int weights[BENCH_CMND_TYPES];
+	double skew;
+	int name_min;
+	int name_max;
+	unsigned long long seed;
+	char *filename;
+	int lazy;
+	int workers;
+} BenchConfig;
+
+/**
+ * @brief Latencies of the commands of one type.
+ *
+ * @param command command character
+ * @param latencies latency of every command in nanoseconds
+ * @param count number of commands run
+ * @param failed number of commands that returned an error
+ * @param total_ns sum of the latencies
+ */
+typedef struct {
+	char command;
+	long long *latencies;
+	int count;
+	int failed;
+	long long total_ns;
+} BenchStats;
+
+unsigned long long bench_random(unsigned long long *state);
+double bench_uniform(unsigned long long *state);
+void bench_id(int index, char *buf);
+int bench_name(unsigned long long *state, const BenchConfig *config, char *buf);
+int bench_pick_student(unsigned long long *state, const BenchConfig *config, int count);
+char bench_pick_command(unsigned long long *state, const BenchConfig *config);
+int bench_parse_args(int argc, char *argv[], BenchConfig *config);
+int bench_run_command(char *input, Student *students_head, BenchStats *stats);
+int compare_latencies(const void *a, const void *b);
+void bench_report(BenchStats *stats, const char *phase);
+int bench(int argc, char *argv[]);
+
+/**
+ * @brief Advances a splitmix64 generator.
+ *
+ * @param state generator state
+ * @return next 64-bit random number
+ */
+unsigned long long bench_random(unsigned long long *state) {
+	unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * @brief Returns a uniform random number in [0, 1).
+ *
+ * @param state generator state
+ * @return random number
+ */
+double bench_uniform(unsigned long long *state) {
+	return (bench_random(state) >> 11) * (1.0 / 9007199254740992.0);   // 53 bits / 2^53
+}
+
+/**
+ * @brief Writes the student ID of the index:th generated Student: the index in base 36.
+ *
+ * @param index
+ * @param buf buffer of at least STDNT_ID_LEN + 1 chars
+ */
+void bench_id(int index, char *buf) {
+	const char *digits = "0123456789abcdefghijklmnopqrstuvwxyz";
+	char tmp[STDNT_ID_LEN];
+	int len = 0;
+
+	do {
+		tmp[len++] = digits[index % 36];
+		index /= 36;
+	} while (index > 0 && len < STDNT_ID_LEN);
+
+	for (int i = 0; i < len; i++) buf[i] = tmp[len - 1 - i];
+	buf[len] = '\0';
+}
+
+/**
+ * @brief Writes a random name of name_min to name_max letters, capitalized.
+ *
+ * @param state generator state
+ * @param config
+ * @param buf buffer of at least name_max + 1 chars
+ * @return length of the name
+ */
+int bench_name(unsigned long long *state, const BenchConfig *config, char *buf) {
+	int len = config -> name_min
+		+ (int)(bench_random(state) % (config -> name_max - config -> name_min + 1));
+
+	for (int i = 0; i < len; i++) {
+		buf[i] = (char)((i == 0 ? 'A' : 'a') + bench_random(state) % 26);
+	}
+	buf[len] = '\0';
+
+	return len;
+}
+
+/**
+ * @brief Picks the index of the Student to update, skewed by config -> skew.
+ *
+ * @param state generator state
+ * @param config
+ * @param count number of Students added so far
+ * @return index of a Student
+ */
+int bench_pick_student(unsigned long long *state, const BenchConfig *config, int count) {
+	int index = (int)(count * pow(bench_uniform(state), config -> skew));
+	return (index < count) ? index : count - 1;
+}
+
+/**
+ * @brief Picks the next command of the mix by the configured weights.
+ *
+ * @param state generator state
+ * @param config
+ * @return command character
+ */
+char bench_pick_command(unsigned long long *state, const BenchConfig *config) {
+	const char commands[BENCH_CMND_TYPES] = {ADD, UPDATE, LIST, WRITE, LOAD};
+	int total = 0;
+	for (int i = 0; i < BENCH_CMND_TYPES; i++) total += config -> weights[i];
+
+	int pick = (int)(bench_random(state) % total);
+	for (int i = 0; i < BENCH_CMND_TYPES; i++) {
+		if (pick < config -> weights[i]) return commands[i];
+		pick -= config -> weights[i];
+	}
+
+	return UPDATE;
+}
+
+/**
+ * @brief Reads the benchmark settings from the command line.
+ *
+ * BENCH: [-n <students>] [-c <commands>] [-m <A:U:L:W:O>] [-z <skew>] [-w <min>:<max>]
+ *        [-s <seed>] [-f <file>] [-l] [-t <threads>]
+ *
+ * @param argc
+ * @param argv
+ * @param config settings, filled with defaults first
+ * @return 0 if successful, ERR_UNKNOWN if the arguments are invalid
+ */
+int bench_parse_args(int argc, char *argv[], BenchConfig *config) {
+	config -> students = BENCH_STUDENTS;
+	config -> commands = BENCH_COMMANDS;
+	sscanf(BENCH_MIX, "%d:%d:%d:%d:%d", &config -> weights[0], &config -> weights[1],
+		&config -> weights[2], &config -> weights[3], &config -> weights[4]);
+	config -> skew = BENCH_SKEW;
+	config -> name_min = BENCH_NAME_MIN;
+	config -> name_max = BENCH_NAME_MAX;
+	config -> seed = BENCH_SEED;
+	config -> filename = BENCH_FILE;
+	config -> lazy = FALSE;
+	config -> workers = 0;
+
+	for (int i = 1; i < argc; i++) {
+		char *opt = argv[i];
+		if (strcmp(opt, "-l") == 0) {
+			config -> lazy = TRUE;
+			continue;
+		}
+		if (opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0' || i + 1 == argc) {
+			return ERR_UNKNOWN;
+		}
+
+		char *val = argv[++i];
+		int ok = TRUE;
+		switch (opt[1]) {
+			case 'n':
+				ok = ((config -> students = validate_int_input(val, FALSE)) >= 1);
+				break;
+			case 'c':
+				ok = ((config -> commands = validate_int_input(val, FALSE)) >= 0);
+				break;
+			case 'm':
+				ok = (sscanf(val, "%d:%d:%d:%d:%d", &config -> weights[0],
+					&config -> weights[1], &config -> weights[2], &config -> weights[3],
+					&config -> weights[4]) == BENCH_CMND_TYPES);
+				for (int j = 0; j < BENCH_CMND_TYPES; j++) ok = ok && config -> weights[j] >= 0;
+				ok = ok && (config -> weights[0] + config -> weights[1] + config -> weights[2]
+					+ config -> weights[3] + config -> weights[4]) > 0;
+				break;
+			case 'z':
+				ok = (sscanf(val, "%lf", &config -> skew) == 1 && config -> skew > 0);
+				break;
+			case 'w':
+				ok = (sscanf(val, "%d:%d", &config -> name_min, &config -> name_max) == 2
+					&& config -> name_min >= 1 && config -> name_max >= config -> name_min);
+				break;
+			case 's':
+				ok = (sscanf(val, "%llu", &config -> seed) == 1);
+				break;
+			case 'f':
+				ok = (validate_filename(val) == 0);
+				config -> filename = val;
+				break;
+			case 't':
+				ok = ((config -> workers = validate_int_input(val, FALSE)) >= 1);
+				break;
+			default:
+				ok = FALSE;
+		}
+		if (!ok) return ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Runs one command through run() and records its latency.
+ *
+ * @param input modifiable command line
+ * @param students_head pointer to the head of the linked list
+ * @param stats statistics of the command's type
+ * @return return value of run()
+ */
+int bench_run_command(char *input, Student *students_head, BenchStats *stats) {
+	long long start = monotonic_ns();
+	int ret = run(input, students_head);
+	long long elapsed = monotonic_ns() - start;
+
+	stats -> latencies[stats -> count++] = elapsed;
+	stats -> total_ns += elapsed;
+	if (ret < 0) stats -> failed++;
+
+	return ret;
+}
+
+/**
+ * @brief Compares two latencies for qsort().
+ *
+ * @param a pointer to long long
+ * @param b pointer to long long
+ * @return <0, 0 or >0
+ */
+int compare_latencies(const void *a, const void *b) {
+	long long x = *(const long long *)a;
+	long long y = *(const long long *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief Prints throughput and latency percentiles of every command type into stderr.
+ *
+ * @param stats array of BENCH_CMND_TYPES statistics, their latencies get sorted
+ * @param phase name of the measured phase
+ */
+void bench_report(BenchStats *stats, const char *phase) {
+	fprintf(stderr, "%s:\n", phase);
+	fprintf(stderr, "  cmd %9s %7s %12s %10s %10s %10s %10s\n", "count", "failed", "ops/s",
+		"p50 us", "p99 us", "p999 us", "max us");
+
+	for (int i = 0; i < BENCH_CMND_TYPES; i++) {
+		BenchStats *s = &stats[i];
+		if (s -> count == 0) continue;
+
+		qsort(s -> latencies, s -> count, sizeof(long long), compare_latencies);
+		long long p50 = s -> latencies[(long long)s -> count * 500 / 1000];
+		long long p99 = s -> latencies[(long long)s -> count * 990 / 1000];
+		long long p999 = s -> latencies[(long long)s -> count * 999 / 1000];
+		double ops = (s -> total_ns > 0) ? s -> count * 1e9 / s -> total_ns : 0.0;
+
+		fprintf(stderr, "  %c   %9d %7d %12.0f %10.2f %10.2f %10.2f %10.2f\n", s -> command,
+			s -> count, s -> failed, ops, p50 / 1e3, p99 / 1e3, p999 / 1e3,
+			s -> latencies[s -> count - 1] / 1e3);
+	}
+}
+
+/**
+ * @brief Runs the benchmark: adds the configured number of Students, writes them into the
+ * benchmark file (so O has something to load) and then runs the command mix. Command output
+ * goes to BENCH_NULL_DEVICE, the report to stderr.
+ *
+ * @param argc
+ * @param argv
+ * @return EXIT_SUCCESS if the benchmark ran, EXIT_FAILURE otherwise
+ */
+int bench(int argc, char *argv[]) {
+	BenchConfig config;
+	if (bench_parse_args(argc, argv, &config)) {
+		fprintf(stderr, "Usage: %s [-n <students>] [-c <commands>] [-m <A:U:L:W:O>] "
+			"[-z <skew>] [-w <min>:<max>] [-s <seed>] [-f <file>] [-l] [-t <threads>]\n",
+			argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	Student *students_head = init_linked_list();
+	if (students_head == NULL) return EXIT_FAILURE;     // Handle alloc failure
+	set_lazy_ordering(students_head, config.lazy);
+	if (config.workers > 0) list_of(students_head) -> workers = config.workers;
+
+	// Room for every command of a phase in every type
+	const char commands[BENCH_CMND_TYPES] = {ADD, UPDATE, LIST, WRITE, LOAD};
+	BenchStats setup[BENCH_CMND_TYPES];
+	BenchStats mix[BENCH_CMND_TYPES];
+	int err = 0;
+	for (int i = 0; i < BENCH_CMND_TYPES; i++) {
+		setup[i] = (BenchStats){commands[i], malloc((config.students + 1) * sizeof(long long)),
+			0, 0, 0};
+		mix[i] = (BenchStats){commands[i], malloc((config.commands + 1) * sizeof(long long)),
+			0, 0, 0};
+		if (setup[i].latencies == NULL || mix[i].latencies == NULL) err = ERR_MEM_ALLOC_FAIL;
+	}
+
+	char *lastname = malloc(config.name_max + 1);
+	char *firstname = malloc(config.name_max + 1);
+	char *input = malloc(2 * config.name_max + FILENAME_MAX + 32);
+	if (lastname == NULL || firstname == NULL || input == NULL) err = ERR_MEM_ALLOC_FAIL;
+
+	// Command output is not part of the report
+	fflush(stdout);
+	if (!err && freopen(BENCH_NULL_DEVICE, "w", stdout) == NULL) err = ERR_FILE_OPEN;
+
+	if (err) {  // Handle error
+		print_error(err);
+		for (int i = 0; i < BENCH_CMND_TYPES; i++) {
+			free(setup[i].latencies);
+			free(mix[i].latencies);
+		}
+		free(lastname);
+		free(firstname);
+		free(input);
+		free_linked_list(students_head);
+		return EXIT_FAILURE;
+	}
+
+	unsigned long long state = config.seed;
+	char id[STDNT_ID_LEN + 1];
+	int added = 0;
+	long long start = monotonic_ns();
+
+	// Setup phase: fill the list
+	for (; added < config.students; added++) {
+		bench_id(added, id);
+		bench_name(&state, &config, lastname);
+		bench_name(&state, &config, firstname);
+		sprintf(input, "%c %s %s %s\n", ADD, id, lastname, firstname);
+		bench_run_command(input, students_head, &setup[0]);
+	}
+	sprintf(input, "%c %s\n", WRITE, config.filename);
+	bench_run_command(input, students_head, &setup[3]);
+	long long setup_ns = monotonic_ns() - start;
+
+	// Mix phase
+	start = monotonic_ns();
+	for (int n = 0; n < config.commands; n++) {
+		char command = bench_pick_command(&state, &config);
+		int type = (int)(strchr(commands, command) - commands);
+
+		switch (command) {
+			case ADD:
+				bench_id(added++, id);
+				bench_name(&state, &config, lastname);
+				bench_name(&state, &config, firstname);
+				sprintf(input, "%c %s %s %s\n", ADD, id, lastname, firstname);
+				break;
+
+			case UPDATE:    // Totals stay within EXCRS_PTS, so O accepts the written file
+				bench_id(bench_pick_student(&state, &config, added), id);
+				sprintf(input, "%c %s %d %d\n", UPDATE, id,
+					1 + (int)(bench_random(&state) % EXCRS_RNDS),
+					(int)(bench_random(&state) % (EXCRS_PTS / EXCRS_RNDS + 1)));
+				break;
+
+			case LIST:
+				sprintf(input, "%c\n", LIST);
+				break;
+
+			default:    // WRITE and LOAD
+				sprintf(input, "%c %s\n", command, config.filename);
+				break;
+		}
+
+		int ret = bench_run_command(input, students_head, &mix[type]);
+		if (command == LOAD && ret == 0) {
+			added = (int)list_of(students_head) -> id_index.count;  // As of the last W
+		}
+	}
+	long long mix_ns = monotonic_ns() - start;
+
+	// Report
+	fprintf(stderr, "Benchmark: %d students, %d commands, mix %d:%d:%d:%d:%d, skew %.2f, "
+		"names %d-%d, seed %llu%s\n", config.students, config.commands, config.weights[0],
+		config.weights[1], config.weights[2], config.weights[3], config.weights[4],
+		config.skew, config.name_min, config.name_max, config.seed,
+		config.lazy ? ", lazy" : "");
+	bench_report(setup, "Setup");
+	fprintf(stderr, "  total %.3f s\n", setup_ns / 1e9);
+	bench_report(mix, "Mix");
+	fprintf(stderr, "  total %.3f s, %.0f commands/s\n", mix_ns / 1e9,
+		(mix_ns > 0) ? config.commands * 1e9 / mix_ns : 0.0);
+
+	for (int i = 0; i < BENCH_CMND_TYPES; i++) {
+		free(setup[i].latencies);
+		free(mix[i].latencies);
+	}
+	free(lastname);
+	free(firstname);
+	free(input);
+	free_linked_list(students_head);
+	remove(config.filename);
+
+	return EXIT_SUCCESS;
+}
+
+#endif
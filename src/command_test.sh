@@ -0,0 +1,123 @@
+#!/bin/sh
+# Command tests, run by "make test". Each tests/<name>.cmd is run in batch mode, with the
+# options in tests/<name>.args if there is one, and its output must equal tests/<name>.out.
+# The tests below them cover what fixed files can't: corrupted snapshots, lists large
+# enough for the parallel paths and concurrent server clients.
+
+EXEC=${1:-./main}
+EXEC="$(cd "$(dirname "$EXEC")" && pwd)/$(basename "$EXEC")"
+TESTS="$(cd "$(dirname "$0")" && pwd)/tests"
+DIR=$(mktemp -d)
+SERVER=
+trap '[ -n "$SERVER" ] && kill $SERVER 2>/dev/null; rm -rf "$DIR"' EXIT
+FAILED=0
+
+# Runs commands in batch mode with the given options. File names can't contain a path, so
+# the program runs in the test directory, next to copies of the test files.
+run() {
+	(cd "$DIR" && printf "$1" | "$EXEC" -b $2 2>/dev/null)
+}
+
+check() {
+	if [ "$2" = "$3" ]; then
+		echo "PASS: $1"
+	else
+		echo "FAIL: $1"
+		echo "  expected: $3"
+		echo "  got:      $2"
+		FAILED=1
+	fi
+}
+
+# Tests with expected output
+for CMD in "$TESTS"/*.cmd; do
+	NAME=$(basename "$CMD" .cmd)
+	ARGS=$(cat "$TESTS/$NAME.args" 2>/dev/null)
+	cp "$TESTS"/*.txt "$DIR"
+	if (cd "$DIR" && "$EXEC" -b $ARGS < "$CMD" 2>/dev/null) | diff "$TESTS/$NAME.out" - \
+		> "$DIR/diff"; then
+		echo "PASS: $NAME"
+	else
+		echo "FAIL: $NAME"
+		sed "s/^/  /" "$DIR/diff"
+		FAILED=1
+	fi
+done
+
+# A snapshot with a corrupted byte is rejected and leaves the list as it was
+run "O students.txt\nW crc.sdb\nQ\n" > /dev/null
+printf "X" | dd of="$DIR/crc.sdb" bs=1 seek=40 conv=notrunc 2>/dev/null
+check "corrupted snapshot is rejected" "$(run "A cc0001 Uusi Opiskelija\nO crc.sdb\nL\nQ\n")" \
+	"SUCCESS
+ERROR (-56) ERR_FILE_CRC: File checksum mismatch, the file is corrupted.
+cc0001 Uusi Opiskelija 0 0 0 0 0 0 0
+SUCCESS
+SUCCESS"
+
+# A list large enough to be parsed, sorted and written by several threads gives the same
+# results as one thread, in the ranking order
+awk 'BEGIN {
+	for (i = 0; i < 100000; i++) {
+		p = (i * 7919) % 61; q = (i * 104729) % 37
+		printf "%06d Last%04d First%03d %d %d 0 0 0 0 %d\n", i, (i * 31) % 5003, i % 997,
+			p, q, p + q
+	}
+}' > "$DIR/big.txt"
+BIG="O big.txt\nL\nW big_out.txt\nW big.sdb\nO big.sdb\nT 5\nP 40 41\nR 000777\nQ\n"
+run "$BIG" "-t 4" > "$DIR/big_t4"
+mv "$DIR/big_out.txt" "$DIR/big_t4.txt"
+run "$BIG" "-t 1" > "$DIR/big_t1"
+SAME=$(cmp "$DIR/big_t4" "$DIR/big_t1" && cmp "$DIR/big_t4.txt" "$DIR/big_out.txt" \
+	&& echo same)
+check "parallel output equals sequential output" "$SAME" "same"
+LC_ALL=C sort -k10,10nr -k2,2 -k3,3 -k1,1 "$DIR/big.txt" > "$DIR/big_sorted"
+check "parallel sort gives the ranking order" \
+	"$(cmp "$DIR/big_sorted" "$DIR/big_t4.txt" && echo sorted)" "sorted"
+
+# Server clients querying while another one loads see either list as a whole (Linux only)
+if [ "$(uname)" = "Linux" ] && command -v perl > /dev/null; then
+	awk 'BEGIN { for (i = 0; i < 2000; i++) printf "a%05d A%d A 10 0 0 0 0 0 10\n", i, i % 97 }' \
+		> "$DIR/a.txt"
+	awk 'BEGIN { for (i = 0; i < 3000; i++) printf "b%05d B%d B 0 20 0 0 0 0 20\n", i, i % 89 }' \
+		> "$DIR/b.txt"
+	(cd "$DIR" && exec "$EXEC" -s db.sock -n 4 -t 4 2>/dev/null) &
+	SERVER=$!
+	for i in 1 2 3 4 5 6 7 8 9 10; do [ -S "$DIR/db.sock" ] || sleep 1; done
+
+	# Sends commands to the server and prints its replies
+	client() {
+		printf "$1" | perl -MIO::Socket::UNIX -e '
+			my $s = IO::Socket::UNIX -> new(Peer => $ARGV[0]) or die;
+			local $/; my $in = <STDIN>; print $s $in; shutdown($s, 1); print <$s>;
+		' "$DIR/db.sock"
+	}
+
+	client "O a.txt\n" > /dev/null
+	client "$(for i in 1 2 3 4 5 6 7 8 9 10; do printf 'O b.txt\\nO a.txt\\n'; done)" \
+		> "$DIR/loads" &
+	CLIENTS=$!
+	QUERIES=$(for i in 1 2 3 4 5 6 7 8 9 10; do printf 'P 0 100\\nL\\n'; done)
+	for c in 1 2 3; do
+		client "$QUERIES" > "$DIR/queries$c" &
+		CLIENTS="$CLIENTS $!"
+	done
+	wait $CLIENTS
+
+	# Every reply must list all of a.txt or all of b.txt
+	LOADS=$(grep -c "^SUCCESS$" "$DIR/loads")/$(awk "END { print NR }" "$DIR/loads")
+	check "concurrent loads succeed" "$LOADS" "20/20"
+	check "queries during loads see whole lists" "$(cat "$DIR"/queries* | awk '
+		/^SUCCESS$/ {
+			if (!(n == 2000 && kind == "a") && !(n == 3000 && kind == "b")) bad++
+			replies++; n = 0; kind = ""; next
+		}
+		{ k = substr($1, 1, 1); if (kind != "" && k != kind) kind = "mixed"; else kind = k; n++ }
+		END { print replies " replies, " bad + 0 " inconsistent" }')" \
+		"60 replies, 0 inconsistent"
+
+	kill $SERVER
+	wait $SERVER 2>/dev/null
+	SERVER=
+fi
+
+exit $FAILED
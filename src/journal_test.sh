@@ -0,0 +1,57 @@
+#!/bin/sh
+# Crash recovery tests of the journal, run by "make test". A crash is simulated by putting
+# back the journal file as it was before a change was made, which leaves the files exactly
+# as a crash at that point would.
+
+EXEC=${1:-./main}
+EXEC="$(cd "$(dirname "$EXEC")" && pwd)/$(basename "$EXEC")"
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+FAILED=0
+
+# Runs commands in batch mode with the journal, printing only the listed Students. File
+# names can't contain a path, so the program runs in the test directory.
+run() {
+	(cd "$DIR" && printf "$1" | "$EXEC" -b -j jr 2>/dev/null | grep -v "^SUCCESS$\|^ERROR")
+}
+
+check() {
+	if [ "$2" = "$3" ]; then
+		echo "PASS: $1"
+	else
+		echo "FAIL: $1"
+		echo "  expected: $3"
+		echo "  got:      $2"
+		FAILED=1
+	fi
+}
+
+# Changes survive a restart
+run "A aa0001 Old Student\nU aa0001 1 10\nQ\n" > /dev/null
+cp "$DIR/jr" "$DIR/jr.before"
+check "changes are replayed" "$(run "L\nQ\n")" "aa0001 Old Student 10 0 0 0 0 0 10"
+
+# Crash after LOAD swapped in its snapshot but before the journal was started over: the
+# changes from before the load must not come back
+printf "bb0001 New Student 0 5 0 0 0 0 5\n" > "$DIR/load.txt"
+run "O load.txt\nQ\n" > /dev/null
+cp "$DIR/jr.before" "$DIR/jr"
+check "journal of an earlier epoch is skipped after LOAD" "$(run "L\nQ\n")" \
+	"bb0001 New Student 0 5 0 0 0 0 5"
+
+# A LOAD whose snapshot can't be written, since a directory is in the way once the journal
+# is open, fails and leaves the list and journal as they were
+printf "cc0001 Other Student 0 0 7 0 0 0 7\n" > "$DIR/load2.txt"
+OUT=$(cd "$DIR" && { sleep 1; mkdir jr.sdb.tmp; printf "O load2.txt\nL\nQ\n"; } \
+	| "$EXEC" -b -j jr 2>/dev/null | grep -v "^SUCCESS$\|^ERROR")
+rmdir "$DIR/jr.sdb.tmp"
+check "failed LOAD keeps the old list" "$OUT" "bb0001 New Student 0 5 0 0 0 0 5"
+check "failed LOAD keeps the old journal" "$(run "L\nQ\n")" \
+	"bb0001 New Student 0 5 0 0 0 0 5"
+
+# A journal of a later epoch than its snapshot can't be replayed
+printf "J 4294967295\n" > "$DIR/jr"
+(cd "$DIR" && printf "Q\n" | "$EXEC" -b -j jr > /dev/null 2>&1)
+check "journal of a later epoch is rejected" "$?" "1"
+
+exit $FAILED
@@ -8,11 +8,32 @@
  * @copyright Copyright (c) 2024
  */
 
+#define _POSIX_C_SOURCE 200809L    // POSIX declarations (mmap() etc.) under -std=c99
+
 #include "project.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+#ifdef __linux__
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
 /* The following block is only used for testing purposes. Comment out "#define TEST" to run
 the program normally.*/
@@ -27,38 +48,25 @@ enum Command {
 	LIST = 'L',
 	WRITE = 'W',
 	LOAD = 'O',
-	QUIT = 'Q'
+	QUIT = 'Q',
+	STATS = 'S',
+	TOP = 'T',
+	RANK = 'R',
+	RANGE = 'P',
+	NAME = 'N',
+	BATCH = 'B'
 };
 
-/**
- * @brief Counts the number of user given arguments in user input string (including
- * command character). One argument is assumed to end either in space or newline.
- *
- * @param input modifiable user input string
- * @return number of arguments found in the input string, error code otherwise
- */
-int count_arguments(char *input) {
-	// Make a copy of the input to prevent modification of the original
-	char *input_copy = malloc(strlen(input) + 1);
-	if (input_copy == NULL) return ERR_MEM_ALLOC_FAIL;  // Handle alloc failure
-	strcpy(input_copy, input);
-
-	char *token = strtok(input_copy, " \n");
-	if (token == NULL) {    // Return error if input not viable
-		free(input_copy);
-		return ERR_NON_VIABLE_INP;
-	}
+// Runtime statistics of the program, printed by STATS
+Stats run_stats;
 
-	// Count arguments
-	int num = 0;
-	while (token != NULL) {
-		num++;
-		token = strtok(NULL, " \n");
-	}
+// Statistics of the current thread not yet added to run_stats
+STATS_LOCAL LocalStats local_stats;
 
-	free(input_copy);
-	return num;
-}
+// The benchmark drives run() and is only built by "make bench"
+#ifdef BENCH
+#include "bench.h"
+#endif
 
 /**
  * @brief Checks that the given string can be successfully converted into an integer and is
@@ -94,15 +102,25 @@ int validate_int_input(char *str, int allow_neg) {
  * @return 0 if valid, error code otherwise
  */
 int validate_id(char *student_id) {
+	return validate_id_span(student_id, strlen(student_id));
+}
+
+/**
+ * @brief Checks that the given student ID of known length is valid. The ID doesn't need to
+ * be '\0'-terminated.
+ *
+ * @param student_id
+ * @param len length of the student ID
+ * @return 0 if valid, error code otherwise
+ */
+int validate_id_span(const char *student_id, size_t len) {
 	// Check length
-	int len = strlen(student_id);
 	if      (len > STDNT_ID_LEN) return ERR_ID_TOO_LONG;
 	else if (len == 0) return ERR_ID_EMPTY;  // Handle exception: empty ID
 
 	// Check that the ID only contains numbers and letters
-	while (*student_id) {
-		if (!isalnum(*student_id)) return ERR_ID_NOT_ALNUM;
-		student_id++;
+	for (size_t i = 0; i < len; i++) {
+		if (!isalnum((unsigned char)student_id[i])) return ERR_ID_NOT_ALNUM;
 	}
 
 	return 0;
@@ -165,109 +183,73 @@ int validate_filename(char *filename) {
 
 /**
  * @brief Takes a line of either user given or file read input string. Parses the possible
- * command character and arguments and populates an Input struct with the info. Returns a
- * pointer to the Input struct when successful, NULL to signal an error.
- *
- * @attention Use free_parsed_input() to free dynamically allocated memory
+ * command character and arguments and populates an Input struct with the info. Counting and
+ * splitting the arguments happen in one pass over the input, and nothing is allocated: the
+ * arguments point into the input string, which gets a '\0' written after each argument.
  *
- * @param input string from user or file
- * @param error pointer to a variable that holds possible errors
+ * @param input modifiable string from user or file
+ * @param parsed_inp Input struct to populate, typically on the caller's stack
  * @param user_input TRUE/FALSE depending whether the Input comes from user or FILE
- * @return pointer to Input struct when successful, NULL otherwise
+ * @return 0 when successful, error code otherwise
  *
- * @note NULL return signifies an error, read "error" var for exact error code
+ * @note On ERR_INV_CMND_CHAR, parsed_inp -> cmnd holds the invalid command character
  */
-Input *parse_input(char *input, int *error, int user_input) {
+int parse_input(char *input, Input *parsed_inp, int user_input) {
 	// Check for empty input
-	if (strlen(input) <= 1) {   // If only "\n" present
-		if (user_input) *error = ERR_EMPTY_INP;     // User input empty
-		else *error = ERR_FILE_CORR;                // Empty line from file -> file corrupt
-		return NULL;
-	}
-
-	// Alloc memory for Input structure
-	Input *parsed_inp = malloc(sizeof(Input));
-	if (parsed_inp == NULL) {   // Handle alloc error
-		*error = ERR_MEM_ALLOC_FAIL;
-		return NULL;
+	size_t len = strlen(input);
+	if (len <= 1) {     // If only "\n" present
+		if (user_input) return ERR_EMPTY_INP;   // User input empty
+		else return ERR_FILE_CORR;              // Empty line from file -> file corrupt
 	}
 
 	// Parse the input for a command character
-	char command = parse_command(input, error);
+	int err = 0;
+	char command = parse_command(input, &err);
 
 	/* =====================================================================================
 	Handles a special case to meet project requirements. This particular error code is only
 	used to print: "Invalid command <command char>\n" into stdout. Otherwise unnecessary and
 	only serves to make code less readable.*/
-	if (*error == ERR_INV_CMND_CHAR) {
+	if (err == ERR_INV_CMND_CHAR) {
 		parsed_inp -> cmnd = command;
-		return parsed_inp;
+		return err;
 	}
 	// =====================================================================================
 
 	// If user input ...
 	if (user_input) {
 		// ... and no valid command char was found, return error
-		if (command == ERR_CHAR) {
-			*error = ERR_NO_CMND_CHAR;
-			free(parsed_inp);
-			return NULL;
-		}
+		if (command == ERR_CHAR) return ERR_NO_CMND_CHAR;
 		// ... and valid command char, populate the struct
 		else parsed_inp -> cmnd = command;
 	}
 	// If FILE input, populate cmnd with NO_CMND_CHAR
 	else parsed_inp -> cmnd = NO_CMND_CHAR;
 
-	// Populate argument count
-	int arg_count = count_arguments(input);
-	if (arg_count < 0) {    // Handle error
-		free(parsed_inp);
-		*error = arg_count;
-		return NULL;
-	}
-	parsed_inp -> arg_count = arg_count;    // Populate Input struct with arg count
-
-	// Populate Input struct with arguments
-	char *token = NULL;
-	char *arg_ptr = NULL;
-	for (int i = 0; i < MAX_ARGS; i++) {
-		if (i == 0) token = strtok(input, " \n");   // First argument
-		else        token = strtok(NULL, " \n");    // Subsequent arguments
+	// The line ends at the first newline
+	char *newline = memchr(input, '\n', len);
+	if (newline != NULL) len = newline - input;
 
-		// Only alloc memory for next argument if token not NULL
-		if (token != NULL) arg_ptr = malloc(strlen(token) + 1);
+	// Split into arguments and count them
+	Span tokens[MAX_ARGS];
+	int arg_count = split_span(input, len, tokens, MAX_ARGS);
+	if (arg_count == 0) return ERR_NON_VIABLE_INP;  // Handle error
+	parsed_inp -> arg_count = arg_count;
 
-		// Handle alloc failure
-		if (arg_ptr == NULL && token != NULL) {
-			for (int j = 0; j < i; j++) free(parsed_inp -> arg_arr[j]); // Free elements
-			free(parsed_inp);   // Free Input struct
-			*error = ERR_MEM_ALLOC_FAIL;
-			return NULL;
+	// Populate Input struct with arguments, terminating each one in place
+	for (int i = 0; i < MAX_ARGS; i++) {
+		if (i < arg_count) {
+			parsed_inp -> arg_arr[i] = input + (tokens[i].start - input);
+			parsed_inp -> arg_len[i] = tokens[i].len;
+			parsed_inp -> arg_arr[i][tokens[i].len] = '\0';
 		}
-
-		// Place the argument into the Input struct array
-		if (token != NULL) {
-			strcpy(arg_ptr, token);
-			parsed_inp -> arg_arr[i] = arg_ptr;
+		else {  // Blanks any unused elements
+			parsed_inp -> arg_arr[i] = NULL;
+			parsed_inp -> arg_len[i] = 0;
 		}
-		else parsed_inp -> arg_arr[i] = NULL;   // Blanks any unused elements
 	}
 
-	return parsed_inp;
-}
-
-/**
- * @brief Frees dynamically allocated memory allocated by parse_input().
- *
- * @param parsed_inp Input struct to be free'd
- */
-void free_parsed_input(Input *parsed_inp) {
-	// Free elements in the argument array
-	for (int i = 0; i < parsed_inp -> arg_count; i++) free(parsed_inp -> arg_arr[i]);
-
-	// Free Input struct
-	free(parsed_inp);
+	return 0;
 }
 
 /**
@@ -290,6 +272,12 @@ char parse_command(char *input, int *error) {
 		case WRITE:     return WRITE;
 		case LOAD:      return LOAD;
 		case QUIT:      return QUIT;
+		case STATS:     return STATS;
+		case TOP:       return TOP;
+		case RANK:      return RANK;
+		case RANGE:     return RANGE;
+		case NAME:      return NAME;
+		case BATCH:     return BATCH;
 		default:
 			*error = ERR_INV_CMND_CHAR;     // Invalid command character
 			return input[0];    // Return invalid command char to meet project requirements
@@ -368,6 +356,57 @@ int validate_input(Input *parsed_inp) {
 				if      (arg_count > QUIT_ARGS) return ERR_TOO_MANY_ARGS;
 				else break;
 
+			case STATS:     // STATS: <'S'>
+				if      (arg_count > STATS_ARGS) return ERR_TOO_MANY_ARGS;
+				else break;
+
+			case TOP:       // TOP: <'T'> <count>
+				if      (arg_count > TOP_ARGS) return ERR_TOO_MANY_ARGS;
+				else if (arg_count < TOP_ARGS) return ERR_TOO_FEW_ARGS;
+
+				// Check for valid count
+				err = validate_int_input(arg_arr[1], FALSE);
+				if (err < 0) return err;
+
+				break;
+
+			case RANK:      // RANK: <'R'> <student ID>
+				if      (arg_count > RANK_ARGS) return ERR_TOO_MANY_ARGS;
+				else if (arg_count < RANK_ARGS) return ERR_TOO_FEW_ARGS;
+
+				// Check for valid student ID
+				err = validate_id(arg_arr[1]);
+				if (err) return err;
+
+				break;
+
+			case RANGE:     // RANGE: <'P'> <min total> <max total>
+				if      (arg_count > RANGE_ARGS) return ERR_TOO_MANY_ARGS;
+				else if (arg_count < RANGE_ARGS) return ERR_TOO_FEW_ARGS;
+
+				// Check for valid totals
+				for (int i = 1; i < RANGE_ARGS; i++) {
+					err = validate_int_input(arg_arr[i], FALSE);
+					if (err < 0) return err;
+				}
+
+				break;
+
+			case NAME:      // NAME: <'N'> <last name prefix>
+				if      (arg_count > NAME_ARGS) return ERR_TOO_MANY_ARGS;
+				else if (arg_count < NAME_ARGS) return ERR_TOO_FEW_ARGS;
+				else break;
+
+			case BATCH:     // BATCH: <'B'> <file name>
+				if      (arg_count > BATCH_ARGS) return ERR_TOO_MANY_ARGS;
+				else if (arg_count < BATCH_ARGS) return ERR_TOO_FEW_ARGS;
+
+				// Validate filename
+				err = validate_filename(arg_arr[1]);
+				if (err) return err;
+
+				break;
+
 			default:    // Not viable command (should never happen due to other checks)
 				return ERR_UNKNOWN;
 		}
@@ -393,6 +432,101 @@ int validate_input(Input *parsed_inp) {
 	return 0;
 }
 
+/**
+ * @brief Splits a line into tokens separated by spaces. The line must not contain the
+ * terminating newline. Only the first max_tokens tokens are stored, but all are counted.
+ *
+ * @param line pointer to the start of the line
+ * @param len length of the line
+ * @param tokens array that receives the tokens
+ * @param max_tokens size of the tokens array
+ * @return number of tokens in the line
+ */
+int split_span(const char *line, size_t len, Span *tokens, int max_tokens) {
+	int count = 0;
+	size_t i = 0;
+
+	while (i < len) {
+		// Skip separators
+		while (i < len && line[i] == ' ') i++;
+		if (i == len) break;
+
+		// Find the end of the token
+		size_t start = i;
+		while (i < len && line[i] != ' ') i++;
+
+		if (count < max_tokens) {
+			tokens[count].start = line + start;
+			tokens[count].len = i - start;
+		}
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * @brief Converts a token of known length into points. Accepts the same forms as
+ * validate_points(): optional leading whitespace and sign followed by decimal digits.
+ *
+ * @param str pointer to the token, doesn't need to be '\0'-terminated
+ * @param len length of the token
+ * @return points when successful, error code otherwise
+ */
+int parse_points_span(const char *str, size_t len) {
+	size_t i = 0;
+	int negative = FALSE;
+	int val = 0;
+
+	while (i < len && isspace((unsigned char)str[i])) i++;  // Like strtol()
+	if (i < len && (str[i] == '+' || str[i] == '-')) negative = (str[i++] == '-');
+
+	// At least one digit, and nothing but digits until the end of the token
+	if (i == len) return ERR_POINTS_CNV;
+	for (; i < len; i++) {
+		if (!isdigit((unsigned char)str[i])) return ERR_POINTS_CNV;
+		if (val <= EXCRS_PTS) val = val * 10 + (str[i] - '0');  // Stop growing once OOB
+	}
+
+	if (negative && val != 0) return ERR_INT_NEG;
+	if (val > EXCRS_PTS) return ERR_PTS_OOB;
+	return val;
+}
+
+/**
+ * @brief Parses and validates one line of a saved file in place. The line must not contain
+ * the terminating newline.
+ *
+ * FILE: <ID> <lname> <fname> <rnd1> ... <rnd6> <totalpts>
+ *
+ * @param line pointer to the start of the line
+ * @param len length of the line
+ * @param has_newline TRUE if the line was terminated by a newline in the file
+ * @param fields array of MAX_ARGS Spans that receives the fields of the line
+ * @param points array of EXCRS_RNDS ints that receives the round points
+ * @return 0 when successful, error code otherwise
+ */
+int parse_record(const char *line, size_t len, int has_newline, Span *fields, int *points) {
+	// Empty line -> file corrupt (same rule as parse_input() uses for files)
+	if (len + (has_newline ? 1 : 0) <= 1) return ERR_FILE_CORR;
+
+	int arg_count = split_span(line, len, fields, MAX_ARGS);
+	if (arg_count == 0) return ERR_NON_VIABLE_INP;
+	if (arg_count != MAX_ARGS) return ERR_FILE_CORR;
+
+	// Validate ID
+	if (validate_id_span(fields[0].start, fields[0].len)) return ERR_FILE_CORR;
+
+	// Validate points
+	for (int i = 0; i < (EXCRS_RNDS + 1); i++) {    // +1 for <totalpts>
+		int val = parse_points_span(fields[i + 3].start, fields[i + 3].len);
+		if (val < 0) return ERR_FILE_CORR;
+		if (i < EXCRS_RNDS) points[i] = val;
+	}
+
+	return 0;
+}
+
 /**
  * @brief Counts the Student's total points.
  *
@@ -405,6 +539,29 @@ int count_points(Student *student) {
 	return points;
 }
 
+/**
+ * @brief Packs total points and the beginning of the last name into one integer, so that
+ * comparing two keys gives the same order as comparing total points (descending) and then
+ * last names with strcmp(), as far as the packed name bytes reach.
+ *
+ * @param total total points of the Student
+ * @param lastname last name of the Student, NULL is treated as an empty name
+ * @return sort key
+ */
+unsigned long long make_sort_key(int total, const char *lastname) {
+	// More points -> smaller key -> earlier in the list
+	unsigned long long key = (unsigned long long)(MAX_TOTAL_PTS - total);
+
+	// Pad with '\0' after the end of the name, like strcmp() sees it
+	for (int i = 0; i < SORT_KEY_NAME_BYTES; i++) {
+		unsigned char c = (lastname != NULL) ? (unsigned char)*lastname : '\0';
+		key = (key << 8) | c;
+		if (c != '\0') lastname++;
+	}
+
+	return key;
+}
+
 /**
  * @brief Sorts two students based on order: total points > last name > first name > student
  * number. For negative return values a comes before b, for positive b comes before a.
@@ -417,7 +574,7 @@ int count_points(Student *student) {
  * @param b Student b
  * @return <0 if a before b, >0 if b before a, 0 if a and b identical
  */
-int sort_students(Student *a, Student *b) {
+int order_students(Student *a, Student *b) {
 	// Check for NULL pointers: -1 if b is NULL, 1 if a is NULL
 	if ((a == NULL) || (b == NULL)) return (a == NULL) ? 1 : -1;
 
@@ -429,17 +586,15 @@ int sort_students(Student *a, Student *b) {
 	char *b_num = b -> student_id;
 	int ret = 0;    // Holds return values
 
-	/* Handle comparison against the head of the linked list. If last name, first name and
-	student number all equal NULL, the Student is the head of the linked list (i.e. the
-	dummy node). This makes sure the head of the list always wins the comparison and won't
-	be moved.*/
-	if (a_lname == NULL && a_fname == NULL && a_num == NULL) return -1;
-	if (b_lname == NULL && b_fname == NULL && b_num == NULL) return 1;
+	/* Handle comparison against the head of the linked list. If the student number is empty,
+	the Student is the head of the linked list (i.e. the dummy node). This makes sure the
+	head of the list always wins the comparison and won't be moved.*/
+	if (a_num[0] == '\0') return -1;
+	if (b_num[0] == '\0') return 1;
 
-	// If a's and b's points are not equal, return -1 if a bigger, and 1 if b bigger.
-	int a_pts = count_points(a);
-	int b_pts = count_points(b);
-	if (a_pts != b_pts) return (a_pts > b_pts) ? -1 : 1;
+	/* Sort keys order by points first, and then by the beginning of the last name. Only
+	when the keys are equal do the names need to be compared in full. */
+	if (a -> sort_key != b -> sort_key) return (a -> sort_key < b -> sort_key) ? -1 : 1;
 
 	// If a's and b's last names are not equal, return <0 if a comes first, >0 if b.
 	if      (a_lname == NULL) return 1;     // Guard (should be unnecessary if not mis-used)
@@ -454,458 +609,4559 @@ int sort_students(Student *a, Student *b) {
 	if (ret != 0) return ret;
 
 	// If all else identical, sort by student number.
-	if      (a_num == NULL) return 1;       // Guard (should be unnecessary if not mis-used)
-	else if (b_num == NULL) return -1;
 	return strcmp(a_num, b_num);
 }
 
+/**
+ * @brief Compares two Students like order_students() and counts the comparison in the
+ * runtime statistics. Used everywhere except on worker threads.
+ *
+ * @param a Student a
+ * @param b Student b
+ * @return <0 if a before b, >0 if b before a, 0 if a and b identical
+ */
+int sort_students(Student *a, Student *b) {
+	local_stats.comparisons++;
+	return order_students(a, b);
+}
+
+/**
+ * @brief Sorts two students by name: last name > first name > student number, all by
+ * strcmp(). Student numbers are unique, so no two Students compare equal.
+ *
+ * @param a Student a
+ * @param b Student b
+ * @return <0 if a before b, >0 if b before a
+ */
+int sort_names(Student *a, Student *b) {
+	int ret = strcmp(a -> lastname, b -> lastname);
+	if (ret != 0) return ret;
+
+	ret = strcmp(a -> firstname, b -> firstname);
+	if (ret != 0) return ret;
+
+	return strcmp(a -> student_id, b -> student_id);
+}
+
 /**
  * @brief Initializes a linked list of Students. Returns the head of the list, which will
  * remain as the head permanently. Student number, last name and first name are all NULL to
- * denote the head.
+ * denote the head. The head is the first member of a ListHead, which also holds the
+ * student ID index of the list.
  *
  * @attention Must be free'd after use.
  *
  * @return Head of Student linked list, NULL if memory allocation failed.
  */
 Student *init_linked_list(void) {
-	Student *list_head = malloc(sizeof(Student));
-	if (list_head == NULL) return NULL;     // Handle alloc failure
+	ListHead *list = malloc(sizeof(ListHead));
+	if (list == NULL) return NULL;          // Handle alloc failure
 
-	list_head -> student_id = NULL;
+	Student *list_head = &list -> node;
+	list_head -> sort_key = 0;
+	list_head -> total = 0;
+	list_head -> student_id[0] = '\0';
 	list_head -> lastname = NULL;
 	list_head -> firstname = NULL;
 	list_head -> next = NULL;
+	list_head -> prev = NULL;
+
+	// Index slots are allocated on the first insert
+	list -> id_index.slots = NULL;
+	list -> id_index.capacity = 0;
+	list -> id_index.count = 0;
+
+	tree_init(&list -> rank_tree, offsetof(Student, rank_link), sort_students);
+	tree_init(&list -> name_index, offsetof(Student, name_link), sort_names);
+	list -> names_stale = FALSE;
+	pool_init(&list -> pool);
+	list -> lazy = FALSE;
+	list -> dirty = FALSE;
+	list -> workers = default_workers();
+	list -> journal = NULL;
 
 	return list_head;
 }
 
 /**
- * @brief Initializes a new Student instance.
+ * @brief Returns the ListHead that owns the given dummy head node.
  *
- * @attention Use free_student() to free memory allocated by this function.
+ * @param students_head pointer to the head of the linked list
+ * @return pointer to the ListHead
+ */
+ListHead *list_of(Student *students_head) {
+	return (ListHead *)students_head;   // "node" is the first member of ListHead
+}
+
+/**
+ * @brief Hashes a student ID string (FNV-1a).
  *
  * @param student_id
- * @param lastname
- * @param firstname
- * @return pointer to new Student instance, NULL if memory allocation failed
+ * @return hash value
  */
-Student *init_student(char *student_id, char *lastname, char *firstname) {
-	char *student_num_ptr = malloc(STDNT_ID_LEN + 1);
-	if (student_num_ptr == NULL) {  // Handle alloc failure
-		return NULL;
+unsigned long hash_id(const char *student_id) {
+	unsigned long hash = 2166136261UL;
+	while (*student_id) {
+		hash ^= (unsigned char)*student_id++;
+		hash *= 16777619UL;
 	}
-	strcpy(student_num_ptr, student_id);   // Init student number
+	return hash;
+}
 
-	char *lastname_ptr = malloc(strlen(lastname) + 1);
-	if (lastname_ptr == NULL) {     // Handle alloc failure
-		free(student_num_ptr);
-		return NULL;
-	}
-	strcpy(lastname_ptr, lastname);         // Init lastname
+/**
+ * @brief Looks up a Student from the index by student ID.
+ *
+ * @param index
+ * @param student_id
+ * @return pointer to the Student, NULL if not found
+ */
+Student *id_index_find(IdIndex *index, const char *student_id) {
+	if (index -> count == 0) return NULL;
 
-	char *firstname_ptr = malloc(strlen(firstname) + 1);
-	if (firstname_ptr == NULL) {    // Handle alloc failure
-		free(lastname_ptr);
-		free(student_num_ptr);
-		return NULL;
-	}
-	strcpy(firstname_ptr, firstname);       // Init firstname
+	size_t mask = index -> capacity - 1;
+	size_t i = hash_id(student_id) & mask;
 
-	Student *new_student = malloc(sizeof(Student));
-	if (new_student == NULL) {      // Handle alloc failure
-		free(student_num_ptr);
-		free(lastname_ptr);
-		free(firstname_ptr);
-		return NULL;
+	// Probe until the ID or an empty slot is found
+	while (index -> slots[i] != NULL) {
+		if (strcmp(index -> slots[i] -> student_id, student_id) == 0) return index -> slots[i];
+		i = (i + 1) & mask;
 	}
 
-	// Populate fields
-	new_student -> student_id = student_num_ptr;
-	new_student -> lastname = lastname_ptr;
-	new_student -> firstname = firstname_ptr;
-	for (int i = 0; i < EXCRS_RNDS; i++) new_student -> points[i] = 0;
-	new_student -> next = NULL;
-
-	return new_student;
+	return NULL;
 }
 
 /**
- * @brief Frees dynamically allocated memory allocated by init_student().
+ * @brief Places a Student into a slot array without checking for duplicates or capacity.
  *
- * @param student pointer to Student instance
+ * @param slots
+ * @param capacity power of two
+ * @param student
  */
-void free_student(Student *student) {
-	free(student -> student_id);
-	free(student -> lastname);
-	free(student -> firstname);
-	free(student);
+void id_slots_place(Student **slots, size_t capacity, Student *student) {
+	size_t mask = capacity - 1;
+	size_t i = hash_id(student -> student_id) & mask;
+	while (slots[i] != NULL) i = (i + 1) & mask;
+	slots[i] = student;
 }
 
 /**
- * @brief Sorts the given Student into the right place in a linked list.
+ * @brief Inserts a Student into the index. Grows the index when it becomes over 70% full.
+ * Assumes the student ID is not already in the index.
  *
+ * @param index
  * @param student
- * @param students_head pointer to the head of the linked list
+ * @return 0 if successful, error code otherwise
  */
-void place_into_list(Student *student, Student *students_head) {
-	Student *curr_student = students_head -> next;  // Current target
-	Student *prev_student = students_head;          // Student before target
+int id_index_insert(IdIndex *index, Student *student) {
+	// Grow when the load factor would exceed 0.7
+	if ((index -> count + 1) * 10 > index -> capacity * 7) {
+		size_t new_cap = (index -> capacity == 0) ? ID_INDEX_INIT_CAP : index -> capacity * 2;
+		Student **new_slots = calloc(new_cap, sizeof(Student *));
+		if (new_slots == NULL) return ERR_MEM_ALLOC_FAIL;   // Handle alloc failure
+
+		// Re-hash the old entries into the new slot array
+		for (size_t i = 0; i < index -> capacity; i++) {
+			if (index -> slots[i] != NULL) id_slots_place(new_slots, new_cap, index -> slots[i]);
+		}
 
-	// Keep comparing Student to others until sort_students() returns >0 or end of list
-	while (curr_student != NULL && sort_students(curr_student, student) < 0) {
-		prev_student = curr_student;
-		curr_student = curr_student -> next;
+		free(index -> slots);
+		index -> slots = new_slots;
+		index -> capacity = new_cap;
 	}
 
-	prev_student -> next = student;     // Place given student
-	student -> next = curr_student;     // Re-link rest of list
+	id_slots_place(index -> slots, index -> capacity, student);
+	index -> count++;
+	return 0;
 }
 
 /**
- * @brief Creates a new Student instance and sorts it into a linked list. Assumes the given
- * linked list is already otherwise sorted. Assumes valid input.
+ * @brief Frees the slot array of the index.
  *
- * @attention The linked list must be first initialized using init_linked_list().
+ * @param index
+ */
+void id_index_free(IdIndex *index) {
+	free(index -> slots);
+	index -> slots = NULL;
+	index -> capacity = 0;
+	index -> count = 0;
+}
+
+/**
+ * @brief Initializes an empty Tree.
  *
- * @param student_id
- * @param lastname
- * @param firstname
- * @param students_head pointer to the head of the linked list
- * @return 0 if successful, error code otherwise
+ * @param tree
+ * @param link_offset offset of the TreeLink used by the tree, e.g. offsetof(Student, rank_link)
+ * @param cmp ordering of the tree
  */
-int add_student(char *student_id, char *lastname, char *firstname, Student *students_head) {
-	// Check the student ID is not already in use
-	Student *curr_student = students_head -> next;
-	while (curr_student != NULL) {
-		if (strcmp(curr_student -> student_id, student_id) == 0) return ERR_STDNT_IN_LIST;
-		curr_student = curr_student -> next;
-	}
+void tree_init(Tree *tree, size_t link_offset, int (*cmp)(Student *a, Student *b)) {
+	tree -> root = NULL;
+	tree -> link_offset = link_offset;
+	tree -> cmp = cmp;
+}
 
-	// Allocate memory for new student and populate fields
-	Student *new_student = init_student(student_id, lastname, firstname);
-	if (new_student == NULL) return ERR_MEM_ALLOC_FAIL;     // Handle alloc failure
+/**
+ * @brief Returns the TreeLink of the given Student that belongs to the given Tree.
+ *
+ * @param tree
+ * @param node
+ * @return pointer to the TreeLink inside the Student
+ */
+TreeLink *tree_link(Tree *tree, Student *node) {
+	return (TreeLink *)((char *)node + tree -> link_offset);
+}
 
-	// Sort into list
-	place_into_list(new_student, students_head);
+/**
+ * @brief Returns the height of a subtree, 0 for an empty subtree.
+ *
+ * @param tree
+ * @param node root of the subtree
+ * @return height of the subtree
+ */
+int tree_height(Tree *tree, Student *node) {
+	return (node == NULL) ? 0 : tree_link(tree, node) -> height;
+}
 
-	return 0;
+/**
+ * @brief Returns the number of Students in a subtree, 0 for an empty subtree.
+ *
+ * @param tree
+ * @param node root of the subtree
+ * @return size of the subtree
+ */
+int tree_size(Tree *tree, Student *node) {
+	return (node == NULL) ? 0 : tree_link(tree, node) -> size;
 }
 
 /**
- * @brief Frees all memory in the linked list onward from the given Student node.
+ * @brief Recalculates the height and size of a node from its children.
  *
- * @param student pointer to a Student node from which free'ing starts
+ * @param tree
+ * @param node
  */
-void free_linked_list(Student *student) {
-	Student *curr_student = student;
-	Student *next_student;
+void tree_update(Tree *tree, Student *node) {
+	TreeLink *link = tree_link(tree, node);
+	int left_h = tree_height(tree, link -> left);
+	int right_h = tree_height(tree, link -> right);
 
-	// Iterates through all nodes in the list
-	while (curr_student != NULL) {
-		next_student = curr_student -> next;
-		free_student(curr_student);
-		curr_student = next_student;
-	}
+	link -> height = 1 + ((left_h > right_h) ? left_h : right_h);
+	link -> size = 1 + tree_size(tree, link -> left) + tree_size(tree, link -> right);
 }
 
 /**
- * @brief Updates a Student's points and re-sorts the linked list. Assumes the linked list
- * is already otherwise sorted. Assumes valid input.
+ * @brief Rotates a subtree to the left.
  *
- * @param student_id
- * @param round
- * @param points
- * @param students_head pointer to the head of the linked list
- * @return 0 if successful, error code otherwise
+ * @param tree
+ * @param node root of the subtree
+ * @return new root of the subtree
  */
-int update_points(char *student_id, char *round, char *points, Student *students_head) {
-	Student *trgt_student = students_head -> next;  // For holding target student
-	Student *prev_student = students_head;          // Student before target
+Student *tree_rotate_left(Tree *tree, Student *node) {
+	Student *pivot = tree_link(tree, node) -> right;
 
-	// Handle exception: empty list
-	if (trgt_student == NULL) return ERR_UPD_PTS_ON_EMPT;
+	tree_link(tree, node) -> right = tree_link(tree, pivot) -> left;
+	tree_link(tree, pivot) -> left = node;
+	tree_update(tree, node);
+	tree_update(tree, pivot);
 
-	// Search for the target student by student number
-	while (strcmp(trgt_student -> student_id, student_id) != 0) {
-		prev_student = trgt_student;            // Keep track of previous Student
-		trgt_student = trgt_student -> next;    // Move on to next
+	return pivot;
+}
 
-		if (trgt_student == NULL) return ERR_STDNT_NOT_FND; // Student not found error
-	}
+/**
+ * @brief Rotates a subtree to the right.
+ *
+ * @param tree
+ * @param node root of the subtree
+ * @return new root of the subtree
+ */
+Student *tree_rotate_right(Tree *tree, Student *node) {
+	Student *pivot = tree_link(tree, node) -> left;
 
-	// Convert strings into int
-	int round_int = atoi(round);
-	int points_int = atoi(points);
+	tree_link(tree, node) -> left = tree_link(tree, pivot) -> right;
+	tree_link(tree, pivot) -> right = node;
+	tree_update(tree, node);
+	tree_update(tree, pivot);
 
-	// Update points
-	trgt_student -> points[round_int - 1] = points_int;
+	return pivot;
+}
 
-	// Re-sort list
-	prev_student -> next = trgt_student -> next;    // Bridge over target Student node
-	place_into_list(trgt_student, students_head);   // Insert target Student back into list
+/**
+ * @brief Restores the AVL balance of a subtree whose children differ in height by at most
+ * two, and updates its height and size.
+ *
+ * @param tree
+ * @param node root of the subtree
+ * @return new root of the subtree
+ */
+Student *tree_balance(Tree *tree, Student *node) {
+	TreeLink *link = tree_link(tree, node);
+	int diff = tree_height(tree, link -> left) - tree_height(tree, link -> right);
+
+	if (diff > 1) {         // Left side too tall
+		TreeLink *left = tree_link(tree, link -> left);
+		if (tree_height(tree, left -> left) < tree_height(tree, left -> right)) {
+			link -> left = tree_rotate_left(tree, link -> left);
+		}
+		return tree_rotate_right(tree, node);
+	}
+	else if (diff < -1) {   // Right side too tall
+		TreeLink *right = tree_link(tree, link -> right);
+		if (tree_height(tree, right -> right) < tree_height(tree, right -> left)) {
+			link -> right = tree_rotate_right(tree, link -> right);
+		}
+		return tree_rotate_left(tree, node);
+	}
 
-	return 0;
+	tree_update(tree, node);
+	return node;
 }
 
 /**
- * @brief Prints the given student's information on a single line in the given stream.
+ * @brief Inserts a Student into a subtree.
  *
- * @param stream
- * @param student
- * @return 0 if successful, error code otherwise
+ * @param tree
+ * @param node root of the subtree, NULL for an empty subtree
+ * @param student Student to insert
+ * @param pred updated to the closest Student before the inserted one, if found in subtree
+ * @param visited incremented by the number of nodes compared against
+ * @return new root of the subtree
  */
-int print_to_stream(FILE *stream, Student *student) {
-	char *number = student -> student_id;
-	char *lastname = student -> lastname;
-	char *firstname = student -> firstname;
+Student *tree_insert_at(Tree *tree, Student *node, Student *student, Student **pred,
+	int *visited) {
+	if (node == NULL) {     // Found the place: new leaf
+		TreeLink *link = tree_link(tree, student);
+		link -> left = NULL;
+		link -> right = NULL;
+		link -> height = 1;
+		link -> size = 1;
+		return student;
+	}
 
-	if (stream == NULL) return ERR_NULL_STRM;     // Handle error
+	TreeLink *link = tree_link(tree, node);
+	(*visited)++;
+	if (tree -> cmp(student, node) < 0) {
+		link -> left = tree_insert_at(tree, link -> left, student, pred, visited);
+	}
+	else {
+		*pred = node;   // Going right: node comes before the inserted Student
+		link -> right = tree_insert_at(tree, link -> right, student, pred, visited);
+	}
+
+	return tree_balance(tree, node);
+}
 
-	// Prints student number, last name and first name
-	fprintf(stream, "%s %s %s ", number, lastname, firstname);
+/**
+ * @brief Inserts a Student into the Tree.
+ *
+ * @param tree
+ * @param student
+ * @param visited receives the number of nodes compared against, may be NULL
+ * @return the Student that comes right before the inserted one, NULL if it's the first
+ */
+Student *tree_insert(Tree *tree, Student *student, int *visited) {
+	Student *pred = NULL;
+	int count = 0;
+	tree -> root = tree_insert_at(tree, tree -> root, student, &pred, &count);
+	if (visited != NULL) *visited = count;
+	return pred;
+}
 
-	// Prints points for each round
-	for (int i = 0; i < EXCRS_RNDS; i++) {
-		fprintf(stream, "%d ", student -> points[i]);
-	}
+/**
+ * @brief Builds a perfectly balanced subtree out of an array of Students that is already
+ * sorted by the ordering of the Tree.
+ *
+ * @param tree
+ * @param sorted array of sorted Students
+ * @param count number of Students in the array
+ * @return root of the built subtree, NULL if count is 0
+ */
+Student *tree_build(Tree *tree, Student **sorted, int count) {
+	if (count <= 0) return NULL;
 
-	// Prints total points
-	fprintf(stream, "%d\n", count_points(student));
+	int mid = count / 2;
+	Student *node = sorted[mid];
+	TreeLink *link = tree_link(tree, node);
+	link -> left = tree_build(tree, sorted, mid);
+	link -> right = tree_build(tree, sorted + mid + 1, count - mid - 1);
+	tree_update(tree, node);
 
-	return 0;
+	return node;
 }
 
 /**
- * @brief Prints the Students in the linked list into stdout.
+ * @brief Finds the Student at the given position of the Tree's order in O(log n).
  *
- * @param students_head pointer to the head of the linked list
- * @return 0 if successful, error code otherwise
+ * @param tree
+ * @param index 0-based position
+ * @return the Student at the position, NULL if index is out of bounds
  */
-int print_status(Student *students_head) {
-	Student *current_student = students_head -> next;
+Student *tree_select(Tree *tree, int index) {
+	Student *node = tree -> root;
 
-	// Go through linked list, printing each Student to stdout
-	while (current_student != NULL) {
-		int err = print_to_stream(stdout, current_student);
-		if (err) return err;    // Handle error
+	while (node != NULL) {
+		TreeLink *link = tree_link(tree, node);
+		int left_size = tree_size(tree, link -> left);
 
-		current_student = current_student -> next;
+		if (index < left_size) node = link -> left;
+		else if (index == left_size) return node;
+		else {
+			index -= left_size + 1;
+			node = link -> right;
+		}
 	}
 
-	return 0;
+	return NULL;
 }
 
 /**
- * @brief Writes the Students in the linked list into file. Assumes valid input.
+ * @brief Counts the Students of the Tree that come before a Student in the Tree's order,
+ * in O(log n), by descending from the root with the Tree's comparison function. The
+ * Student doesn't have to be in the Tree, so this also tells where it would rank among
+ * the Students of another Tree with the same order.
  *
- * @param filename
- * @param students_head pointer to the head of the linked list
- * @return 0 if successful, error code otherwise
+ * @param tree
+ * @param student
+ * @return number of Students before the Student, its 0-based position if it is in the Tree
  */
-int write_to_file(char *filename, Student *students_head) {
-	Student *curr_student = students_head -> next;  // Start from first non-dummy Student
+int tree_count_before(Tree *tree, Student *student) {
+	Student *node = tree -> root;
+	int count = 0;
+
+	while (node != NULL) {
+		TreeLink *link = tree_link(tree, node);
+		if (node == student) return count + tree_size(tree, link -> left);
+
+		if (tree -> cmp(student, node) < 0) node = link -> left;
+		else {
+			count += tree_size(tree, link -> left) + 1;
+			node = link -> right;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * @brief Finds the first Student of the Tree's order that doesn't come before a key, in
+ * O(log n). The order of the Tree must agree with the key: before() is TRUE for some
+ * (possibly empty) prefix of the order and FALSE for the rest.
+ *
+ * @param tree
+ * @param before function that tells if a Student comes before the key
+ * @param key
+ * @return first Student for which before() is FALSE, NULL if there is none
+ */
+Student *tree_seek(Tree *tree, int (*before)(Student *node, const void *key),
+	const void *key) {
+	Student *node = tree -> root;
+	Student *found = NULL;
+
+	while (node != NULL) {
+		TreeLink *link = tree_link(tree, node);
+		if (before(node, key)) node = link -> right;
+		else {
+			found = node;   // Candidate, look for an earlier one on the left
+			node = link -> left;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * @brief Counts the Students of the Tree that come before a key, in O(log n). The order of
+ * the Tree must agree with the key like in tree_seek().
+ *
+ * @param tree
+ * @param before function that tells if a Student comes before the key
+ * @param key
+ * @return number of Students for which before() is TRUE
+ */
+int tree_count_prefix(Tree *tree, int (*before)(Student *node, const void *key),
+	const void *key) {
+	Student *node = tree -> root;
+	int count = 0;
+
+	while (node != NULL) {
+		TreeLink *link = tree_link(tree, node);
+		if (before(node, key)) {
+			count += tree_size(tree, link -> left) + 1;
+			node = link -> right;
+		}
+		else node = link -> left;
+	}
+
+	return count;
+}
+
+/**
+ * @brief Starts an in-order iteration of a Tree from the first Student that doesn't come
+ * before a key, like tree_seek(), in O(log n).
+ *
+ * @param iter
+ * @param tree
+ * @param before function that tells if a Student comes before the key
+ * @param key
+ */
+void tree_iter_seek(TreeIter *iter, Tree *tree, int (*before)(Student *node, const void *key),
+	const void *key) {
+	iter -> tree = tree;
+	iter -> depth = 0;
+
+	Student *node = tree -> root;
+	while (node != NULL) {
+		TreeLink *link = tree_link(tree, node);
+		if (before(node, key)) node = link -> right;
+		else {
+			iter -> path[iter -> depth++] = node;   // Comes after everything on its left
+			node = link -> left;
+		}
+	}
+}
+
+/**
+ * @brief Returns the next Student of an in-order iteration, in O(1) amortized time.
+ *
+ * @param iter iterator started by tree_iter_seek()
+ * @return the next Student, NULL when the Tree has ended
+ */
+Student *tree_iter_next(TreeIter *iter) {
+	if (iter -> depth == 0) return NULL;
+	Student *next = iter -> path[--iter -> depth];
+
+	// The right subtree comes next, starting from its leftmost Student
+	for (Student *node = tree_link(iter -> tree, next) -> right; node != NULL;
+		node = tree_link(iter -> tree, node) -> left) {
+		iter -> path[iter -> depth++] = node;
+	}
+
+	return next;
+}
+
+/**
+ * @brief Detaches the first Student of a subtree.
+ *
+ * @param tree
+ * @param node root of the subtree, must not be NULL
+ * @param min set to the detached Student
+ * @return new root of the subtree
+ */
+Student *tree_remove_min(Tree *tree, Student *node, Student **min) {
+	TreeLink *link = tree_link(tree, node);
+	if (link -> left == NULL) {
+		*min = node;
+		return link -> right;
+	}
+
+	link -> left = tree_remove_min(tree, link -> left, min);
+	return tree_balance(tree, node);
+}
+
+/**
+ * @brief Removes a Student from a subtree. The Student must be in the subtree and its
+ * ordering fields must not have changed since it was inserted.
+ *
+ * @param tree
+ * @param node root of the subtree
+ * @param student Student to remove
+ * @return new root of the subtree
+ */
+Student *tree_remove_at(Tree *tree, Student *node, Student *student) {
+	if (node == NULL) return NULL;  // Guard (should never happen if not mis-used)
+
+	TreeLink *link = tree_link(tree, node);
+	if (node != student) {
+		if (tree -> cmp(student, node) < 0) link -> left = tree_remove_at(tree, link -> left, student);
+		else link -> right = tree_remove_at(tree, link -> right, student);
+		return tree_balance(tree, node);
+	}
+
+	// Found: replace the node with the first Student of its right subtree
+	if (link -> left == NULL) return link -> right;
+	if (link -> right == NULL) return link -> left;
+
+	Student *successor = NULL;
+	Student *right = tree_remove_min(tree, link -> right, &successor);
+	tree_link(tree, successor) -> left = link -> left;
+	tree_link(tree, successor) -> right = right;
+	return tree_balance(tree, successor);
+}
+
+/**
+ * @brief Removes a Student from the Tree. Must be called before changing any of the fields
+ * that the Tree is ordered by.
+ *
+ * @param tree
+ * @param student
+ */
+void tree_remove(Tree *tree, Student *student) {
+	tree -> root = tree_remove_at(tree, tree -> root, student);
+}
+
+/**
+ * @brief Initializes an empty StudentPool. Nothing is allocated until the first Student.
+ *
+ * @param pool
+ */
+void pool_init(StudentPool *pool) {
+	pool -> slabs = NULL;
+	pool -> free_nodes = NULL;
+	pool -> names = NULL;
+}
+
+/**
+ * @brief Hands out one uninitialized Student node from the pool.
+ *
+ * @param pool
+ * @return pointer to the node, NULL if memory allocation failed
+ */
+Student *pool_alloc_student(StudentPool *pool) {
+	// Reuse a node given back by free_student()
+	if (pool -> free_nodes != NULL) {
+		Student *node = pool -> free_nodes;
+		pool -> free_nodes = node -> next;
+		return node;
+	}
+
+	// Start a new slab when the current one is full
+	if (pool -> slabs == NULL || pool -> slabs -> used == POOL_SLAB_STUDENTS) {
+		StudentSlab *slab = malloc(sizeof(StudentSlab));
+		if (slab == NULL) return NULL;  // Handle alloc failure
+		slab -> used = 0;
+		slab -> next = pool -> slabs;
+		pool -> slabs = slab;
+	}
+
+	return &pool -> slabs -> nodes[pool -> slabs -> used++];
+}
+
+/**
+ * @brief Copies a string of known length into the pool's name arena and '\0'-terminates
+ * it.
+ *
+ * @param pool
+ * @param str string to copy, doesn't need to be '\0'-terminated
+ * @param len length of the string
+ * @return pointer to the copy, NULL if memory allocation failed
+ */
+char *pool_alloc_string(StudentPool *pool, const char *str, size_t len) {
+	size_t need = len + 1;
+	NameBlock *block = pool -> names;
+
+	if (block == NULL || block -> size - block -> used < need) {
+		// Long strings get a block of their own behind the current one, which stays in use
+		size_t size = (need > POOL_BLOCK_SIZE / 4) ? need : POOL_BLOCK_SIZE;
+		NameBlock *new_block = malloc(sizeof(NameBlock) + size);
+		if (new_block == NULL) return NULL;     // Handle alloc failure
+		new_block -> used = 0;
+		new_block -> size = size;
+
+		if (size == need && block != NULL) {
+			new_block -> next = block -> next;
+			block -> next = new_block;
+		}
+		else {
+			new_block -> next = block;
+			pool -> names = new_block;
+		}
+		block = new_block;
+	}
+
+	char *copy = block -> data + block -> used;
+	block -> used += need;
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+/**
+ * @brief Frees every slab and name block of the pool at once. All Students allocated from
+ * the pool become invalid.
+ *
+ * @param pool
+ */
+void pool_release(StudentPool *pool) {
+	while (pool -> slabs != NULL) {
+		StudentSlab *next = pool -> slabs -> next;
+		free(pool -> slabs);
+		pool -> slabs = next;
+	}
+	while (pool -> names != NULL) {
+		NameBlock *next = pool -> names -> next;
+		free(pool -> names);
+		pool -> names = next;
+	}
+	pool -> free_nodes = NULL;
+}
+
+/**
+ * @brief Moves all memory of one pool into another. Afterwards the Students and strings of
+ * src belong to dst and src is empty.
+ *
+ * @param dst pool that takes over the memory
+ * @param src pool that gives up its memory
+ */
+void pool_merge(StudentPool *dst, StudentPool *src) {
+	// Append the chains of src after those of dst, so dst keeps filling its own first ones
+	StudentSlab **slab_tail = &dst -> slabs;
+	while (*slab_tail != NULL) slab_tail = &(*slab_tail) -> next;
+	*slab_tail = src -> slabs;
+
+	NameBlock **block_tail = &dst -> names;
+	while (*block_tail != NULL) block_tail = &(*block_tail) -> next;
+	*block_tail = src -> names;
+
+	Student **node_tail = &dst -> free_nodes;
+	while (*node_tail != NULL) node_tail = &(*node_tail) -> next;
+	*node_tail = src -> free_nodes;
+
+	pool_init(src);
+}
+
+/**
+ * @brief Initializes a new Student instance.
+ *
+ * @attention The Student lives as long as the pool it was allocated from.
+ *
+ * @param pool pool that owns the Student
+ * @param student_id
+ * @param lastname
+ * @param firstname
+ * @return pointer to new Student instance, NULL if memory allocation failed
+ */
+Student *init_student(StudentPool *pool, char *student_id, char *lastname, char *firstname) {
+	return init_student_n(pool, student_id, strlen(student_id), lastname, strlen(lastname),
+		firstname, strlen(firstname));
+}
+
+/**
+ * @brief Initializes a new Student instance from strings of known length, which don't need
+ * to be '\0'-terminated. Each string is copied exactly once: the ID into the Student
+ * itself and the names into the pool's name arena.
+ *
+ * @attention The Student lives as long as the pool it was allocated from.
+ *
+ * @param pool pool that owns the Student
+ * @param student_id
+ * @param id_len length of student_id, at most STDNT_ID_LEN
+ * @param lastname
+ * @param lastname_len length of lastname
+ * @param firstname
+ * @param firstname_len length of firstname
+ * @return pointer to new Student instance, NULL if memory allocation failed
+ */
+Student *init_student_n(StudentPool *pool, const char *student_id, size_t id_len,
+	const char *lastname, size_t lastname_len, const char *firstname, size_t firstname_len) {
+	// On failure, a name already copied stays in the arena until the pool is released
+	char *lastname_ptr = pool_alloc_string(pool, lastname, lastname_len);
+	char *firstname_ptr = pool_alloc_string(pool, firstname, firstname_len);
+	if (lastname_ptr == NULL || firstname_ptr == NULL) return NULL;     // Handle alloc failure
+
+	Student *new_student = pool_alloc_student(pool);
+	if (new_student == NULL) return NULL;   // Handle alloc failure
+
+	// Populate fields
+	memcpy(new_student -> student_id, student_id, id_len);
+	new_student -> student_id[id_len] = '\0';
+	new_student -> lastname = lastname_ptr;
+	new_student -> firstname = firstname_ptr;
+	for (int i = 0; i < EXCRS_RNDS; i++) new_student -> points[i] = 0;
+	new_student -> total = 0;
+	new_student -> sort_key = make_sort_key(0, lastname_ptr);
+	new_student -> next = NULL;
+	new_student -> prev = NULL;
+
+	return new_student;
+}
+
+/**
+ * @brief Gives a Student node back to its pool for reuse. The Student's names stay in the
+ * name arena until the whole pool is released.
+ *
+ * @param pool pool the Student was allocated from
+ * @param student pointer to Student instance
+ */
+void free_student(StudentPool *pool, Student *student) {
+	student -> next = pool -> free_nodes;
+	pool -> free_nodes = student;
+}
+
+/**
+ * @brief Sorts the given Student into the right place in a linked list. The place is found
+ * from the ranking tree of the list in O(log n).
+ *
+ * @param student
+ * @param students_head pointer to the head of the linked list
+ */
+void place_into_list(Student *student, Student *students_head) {
+	// The Student before the new one in the tree is also the one before it in the list
+	int visited;
+	Student *prev_student = tree_insert(&list_of(students_head) -> rank_tree, student, &visited);
+	local_stats.placements++;
+	local_stats.placement_nodes += visited;
+	if (prev_student == NULL) prev_student = students_head;
+	Student *curr_student = prev_student -> next;
+
+	prev_student -> next = student;     // Place given student
+	student -> prev = prev_student;
+	student -> next = curr_student;     // Re-link rest of list
+	if (curr_student != NULL) curr_student -> prev = student;
+}
+
+/**
+ * @brief Takes the given Student out of a linked list and its ranking tree. Must be called
+ * before changing the Student's points.
+ *
+ * @param student
+ * @param students_head pointer to the head of the linked list
+ */
+void remove_from_list(Student *student, Student *students_head) {
+	tree_remove(&list_of(students_head) -> rank_tree, student);
+
+	student -> prev -> next = student -> next;  // Bridge over the Student node
+	if (student -> next != NULL) student -> next -> prev = student -> prev;
+	student -> next = NULL;
+	student -> prev = NULL;
+}
+
+/**
+ * @brief Creates a new Student instance and sorts it into a linked list. Assumes the given
+ * linked list is already otherwise sorted. Assumes valid input. In lazy ordering mode the
+ * Student is put first in the list and the list is only marked out of order.
+ *
+ * @attention The linked list must be first initialized using init_linked_list().
+ *
+ * @param student_id
+ * @param lastname
+ * @param firstname
+ * @param students_head pointer to the head of the linked list
+ * @return 0 if successful, error code otherwise
+ */
+int add_student(char *student_id, char *lastname, char *firstname, Student *students_head) {
+	ListHead *list = list_of(students_head);
+	IdIndex *id_index = &list -> id_index;
+
+	// Check the student ID is not already in use
+	if (id_index_find(id_index, student_id) != NULL) return ERR_STDNT_IN_LIST;
+
+	// Allocate memory for new student and populate fields
+	StudentPool *pool = &list -> pool;
+	Student *new_student = init_student(pool, student_id, lastname, firstname);
+	if (new_student == NULL) return ERR_MEM_ALLOC_FAIL;     // Handle alloc failure
+
+	// Add to the ID index
+	if (id_index_insert(id_index, new_student)) {   // Handle alloc failure
+		free_student(pool, new_student);
+		return ERR_MEM_ALLOC_FAIL;
+	}
+
+	// Lazy ordering: link in first, sort when the list is read
+	if (list -> lazy) {
+		new_student -> prev = students_head;
+		new_student -> next = students_head -> next;
+		if (new_student -> next != NULL) new_student -> next -> prev = new_student;
+		students_head -> next = new_student;
+		list -> dirty = TRUE;
+	}
+	else place_into_list(new_student, students_head);   // Sort into list
+
+	// Names never change, so the name index is only updated here
+	if (!list -> names_stale) tree_insert(&list -> name_index, new_student, NULL);
+
+	return journal_record(students_head, ADD, student_id, lastname, firstname);
+}
+
+/**
+ * @brief Frees all memory of the linked list: the pool that holds every Student and name,
+ * the indexes and the head itself. Takes time proportional to the number of pool blocks,
+ * not the number of Students.
+ *
+ * @param students_head pointer to the head of the linked list
+ */
+void free_linked_list(Student *students_head) {
+	if (students_head == NULL) return;
+
+	ListHead *list = list_of(students_head);
+	if (list -> journal != NULL) journal_close(list -> journal);
+	pool_release(&list -> pool);
+	id_index_free(&list -> id_index);
+	free(list);
+}
+
+/**
+ * @brief Starts merging sorted runs of Students with an empty heap. The runs are added
+ * with merge_push().
+ *
+ * @param heap
+ * @param cmp order of the runs and of the merged Students
+ */
+void merge_init(MergeHeap *heap, int (*cmp)(Student *a, Student *b)) {
+	heap -> count = 0;
+	heap -> cmp = cmp;
+}
+
+/**
+ * @brief Adds the next Student of a run to the heap, in O(log runs). Each run has at most
+ * one Student in the heap at a time.
+ *
+ * @param heap
+ * @param student next Student of the run, NULL if the run has ended
+ * @param run number of the run, returned by merge_pop() with the Student
+ */
+void merge_push(MergeHeap *heap, Student *student, int run) {
+	if (student == NULL) return;
+
+	// Sift the new Student up
+	int child = heap -> count++;
+	while (child > 0 && heap -> cmp(student, heap -> heads[(child - 1) / 2]) < 0) {
+		heap -> heads[child] = heap -> heads[(child - 1) / 2];
+		heap -> runs[child] = heap -> runs[(child - 1) / 2];
+		child = (child - 1) / 2;
+	}
+	heap -> heads[child] = student;
+	heap -> runs[child] = run;
+}
+
+/**
+ * @brief Removes the first Student from the heap, in O(log runs). The next Student of its
+ * run, if any, is then added with merge_push().
+ *
+ * @param heap
+ * @param run set to the number of the Student's run, may be NULL
+ * @return the first Student, NULL if the heap is empty
+ */
+Student *merge_pop(MergeHeap *heap, int *run) {
+	if (heap -> count == 0) return NULL;
+	Student *first = heap -> heads[0];
+	if (run != NULL) *run = heap -> runs[0];
+
+	// Sift the last Student down from the top
+	Student *moved = heap -> heads[--heap -> count];
+	int moved_run = heap -> runs[heap -> count];
+	int parent = 0;
+	for (;;) {
+		int child = 2 * parent + 1;
+		if (child >= heap -> count) break;
+		if (child + 1 < heap -> count
+			&& heap -> cmp(heap -> heads[child + 1], heap -> heads[child]) < 0) child++;
+		if (heap -> cmp(moved, heap -> heads[child]) < 0) break;
+		heap -> heads[parent] = heap -> heads[child];
+		heap -> runs[parent] = heap -> runs[child];
+		parent = child;
+	}
+	if (heap -> count > 0) {
+		heap -> heads[parent] = moved;
+		heap -> runs[parent] = moved_run;
+	}
+
+	return first;
+}
+
+/**
+ * @brief Starts merging sorted linked lists, or parts of them, in the order of
+ * sort_students(). Each run continues from its first Student along the "next" pointers,
+ * see merge_next().
+ *
+ * @param heap
+ * @param firsts first Student of each run, NULL for an empty run
+ * @param count number of runs, at most MAX_SHARDS
+ */
+void merge_lists(MergeHeap *heap, Student **firsts, int count) {
+	merge_init(heap, sort_students);
+	for (int i = 0; i < count; i++) merge_push(heap, firsts[i], i);
+}
+
+/**
+ * @brief Returns the next Student of the runs started by merge_lists(), in O(log runs).
+ *
+ * @param heap
+ * @return the next Student, NULL when every run has ended
+ */
+Student *merge_next(MergeHeap *heap) {
+	int run;
+	Student *first = merge_pop(heap, &run);
+	if (first != NULL) merge_push(heap, first -> next, run);
+	return first;
+}
+
+/**
+ * @brief Makes a deep copy of sorted linked lists merged into one: every Student and name
+ * is copied into the new list's own pool, so the copy stays valid whatever happens to the
+ * originals. The lists are merged with a MergeHeap, and the copy is linked and indexed
+ * without sorting, in O(n log count). The copy has no journal.
+ *
+ * @attention The lists must be sorted, see ensure_sorted(). Use free_linked_list() to free
+ * the copy.
+ *
+ * @param heads pointers to the heads of the linked lists
+ * @param count number of lists, at most MAX_SHARDS
+ * @return pointer to the head of the copy, NULL if memory allocation failed
+ */
+Student *merge_linked_lists(Student **heads, int count) {
+	int total = 0;
+	Student *firsts[MAX_SHARDS];
+	for (int i = 0; i < count; i++) {
+		total += (int)list_of(heads[i]) -> id_index.count;
+		firsts[i] = heads[i] -> next;
+	}
+
+	Student *copy_head = init_linked_list();
+	Student **sorted = malloc((total > 0 ? total : 1) * sizeof(Student *));
+	if (copy_head == NULL || sorted == NULL) {  // Handle alloc failure
+		free_linked_list(copy_head);
+		free(sorted);
+		return NULL;
+	}
+	ListHead *copy = list_of(copy_head);
+	copy -> workers = list_of(heads[0]) -> workers;
+
+	MergeHeap heap;
+	merge_lists(&heap, firsts, count);
+	Student *s;
+	for (int i = 0; (s = merge_next(&heap)) != NULL; i++) {
+		sorted[i] = init_student(&copy -> pool, s -> student_id, s -> lastname, s -> firstname);
+		if (sorted[i] == NULL || id_index_insert(&copy -> id_index, sorted[i])) {
+			// Handle alloc failure
+			free_linked_list(copy_head);
+			free(sorted);
+			return NULL;
+		}
+
+		memcpy(sorted[i] -> points, s -> points, sizeof(s -> points));
+		sorted[i] -> total = s -> total;
+		sorted[i] -> sort_key = s -> sort_key;
+	}
+
+	link_sorted(sorted, total, copy_head);
+	copy -> names_stale = TRUE;     // Built on the first NAME, if any
+
+	free(sorted);
+	return copy_head;
+}
+
+/**
+ * @brief Picks the shard of a student ID. The ID index masks hash_id() with its capacity,
+ * so taking some of those bits as the shard would crowd the IDs of one shard into part of
+ * its index. The hash is mixed with the MurmurHash3 finalizer first instead, which spreads
+ * every bit over all the others.
+ *
+ * @param student_id
+ * @param count number of shards
+ * @return shard number, 0 to count - 1
+ */
+int shard_of(const char *student_id, int count) {
+	unsigned long hash = hash_id(student_id) & 0xFFFFFFFFUL;
+	hash ^= hash >> 16;
+	hash = (hash * 0x85EBCA6BUL) & 0xFFFFFFFFUL;
+	hash ^= hash >> 13;
+	hash = (hash * 0xC2B2AE35UL) & 0xFFFFFFFFUL;
+	hash ^= hash >> 16;
+	return (int)(hash % (unsigned long)count);
+}
+
+/**
+ * @brief Makes a deep copy of a sorted linked list split into new lists by shard_of() the
+ * student IDs. Each new list is linked and indexed without sorting, in O(n), and gets the
+ * ordering mode and worker count of the original.
+ *
+ * @attention The list must be sorted, see ensure_sorted(). Use free_linked_list() to free
+ * the new lists.
+ *
+ * @param students_head pointer to the head of the linked list
+ * @param shards receives pointers to the heads of the new lists
+ * @param count number of new lists, at most MAX_SHARDS
+ * @return 0 if successful, error code otherwise
+ */
+int split_linked_list(Student *students_head, Student **shards, int count) {
+	ListHead *list = list_of(students_head);
+	int total = (int)list -> id_index.count;
+
+	// Each shard gets its own range of one array of sorted Students
+	int starts[MAX_SHARDS + 1] = {0};
+	for (Student *s = students_head -> next; s != NULL; s = s -> next) {
+		starts[shard_of(s -> student_id, count) + 1]++;
+	}
+	for (int i = 0; i < count; i++) starts[i + 1] += starts[i];
+
+	int err = 0;
+	Student **sorted = malloc((total > 0 ? total : 1) * sizeof(Student *));
+	if (sorted == NULL) err = ERR_MEM_ALLOC_FAIL;   // Handle alloc failure
+	for (int i = 0; i < count; i++) {
+		shards[i] = err ? NULL : init_linked_list();
+		if (shards[i] == NULL) err = ERR_MEM_ALLOC_FAIL;    // Handle alloc failure
+		else {
+			set_lazy_ordering(shards[i], list -> lazy);
+			list_of(shards[i]) -> workers = list -> workers;
+		}
+	}
+
+	int ends[MAX_SHARDS];
+	memcpy(ends, starts, sizeof(ends));
+	for (Student *s = students_head -> next; s != NULL && !err; s = s -> next) {
+		int i = shard_of(s -> student_id, count);
+		ListHead *shard = list_of(shards[i]);
+
+		Student *copy = init_student(&shard -> pool, s -> student_id, s -> lastname,
+			s -> firstname);
+		if (copy == NULL || id_index_insert(&shard -> id_index, copy)) {
+			err = ERR_MEM_ALLOC_FAIL;   // Handle alloc failure
+			break;
+		}
+
+		memcpy(copy -> points, s -> points, sizeof(s -> points));
+		copy -> total = s -> total;
+		copy -> sort_key = s -> sort_key;
+		sorted[ends[i]++] = copy;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (err) {  // Handle error: free every new list
+			free_linked_list(shards[i]);
+			shards[i] = NULL;
+		}
+		else {
+			link_sorted(sorted + starts[i], starts[i + 1] - starts[i], shards[i]);
+			list_of(shards[i]) -> names_stale = TRUE;   // Built on the first NAME, if any
+		}
+	}
+
+	free(sorted);
+	return err;
+}
+
+/**
+ * @brief Sets the points of one round of a Student and updates the total and sort key.
+ *
+ * @attention The Student must not be in a sorted list while its points change.
+ *
+ * @param student
+ * @param round round number, 1 to EXCRS_RNDS
+ * @param points
+ */
+void set_round_points(Student *student, int round, int points) {
+	int *round_pts = &student -> points[round - 1];
+	student -> total += points - *round_pts;
+	*round_pts = points;
+	student -> sort_key = make_sort_key(student -> total, student -> lastname);
+}
+
+/**
+ * @brief Updates a Student's points and re-sorts the linked list. Assumes the linked list
+ * is already otherwise sorted. Assumes valid input. In lazy ordering mode the list is only
+ * marked out of order.
+ *
+ * @param student_id
+ * @param round
+ * @param points
+ * @param students_head pointer to the head of the linked list
+ * @return 0 if successful, error code otherwise
+ */
+int update_points(char *student_id, char *round, char *points, Student *students_head) {
+	// Handle exception: empty list
+	if (students_head -> next == NULL) return ERR_UPD_PTS_ON_EMPT;
+
+	// Search for the target student by student number
+	ListHead *list = list_of(students_head);
+	Student *trgt_student = id_index_find(&list -> id_index, student_id);
+	if (trgt_student == NULL) return ERR_STDNT_NOT_FND;     // Student not found error
+
+	// Convert strings into int
+	int round_int = atoi(round);
+	int points_int = atoi(points);
+
+	// Take the target out of the list while its points change
+	if (!list -> lazy) remove_from_list(trgt_student, students_head);
+	set_round_points(trgt_student, round_int, points_int);
+
+	// Lazy ordering: sort when the list is read
+	if (list -> lazy) list -> dirty = TRUE;
+	else place_into_list(trgt_student, students_head);  // Insert target back into list
+
+	return journal_record(students_head, UPDATE, student_id, round, points);
+}
+
+/**
+ * @brief Turns lazy ordering mode on or off. In lazy mode add_student() and update_points()
+ * leave the list out of order, and it is sorted once by ensure_sorted() when it is read.
+ *
+ * @param students_head pointer to the head of the linked list
+ * @param lazy TRUE for lazy ordering, FALSE for keeping the list sorted at all times
+ * @note Turning lazy mode off sorts the list if needed, unless memory allocation fails
+ */
+void set_lazy_ordering(Student *students_head, int lazy) {
+	if (!lazy) ensure_sorted(students_head);
+	list_of(students_head) -> lazy = lazy;
+}
+
+/**
+ * @brief Returns the default number of worker threads: the number of online processors.
+ *
+ * @return number of workers, at least 1 and at most MAX_WORKERS
+ */
+int default_workers(void) {
+	#ifndef _WIN32
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1) return 1;
+	return (cpus > MAX_WORKERS) ? MAX_WORKERS : (int)cpus;
+	#else
+	return 1;
+	#endif
+}
+
+/**
+ * @brief Runs job_fn on every job in an array of jobs, each in its own thread, and waits
+ * for all of them to finish. A job whose thread can't be started is run by the calling
+ * thread instead, and without threads support all jobs are run one after another.
+ *
+ * @param job_fn function that does one job
+ * @param jobs array of jobs
+ * @param job_size size of one job in bytes
+ * @param count number of jobs, at most MAX_WORKERS
+ */
+void run_parallel(void *(*job_fn)(void *), void *jobs, size_t job_size, int count) {
+	#ifndef _WIN32
+	pthread_t threads[MAX_WORKERS];
+	int started[MAX_WORKERS];
+
+	for (int i = 0; i < count; i++) {
+		void *job = (char *)jobs + i * job_size;
+		started[i] = (pthread_create(&threads[i], NULL, job_fn, job) == 0);
+		if (!started[i]) job_fn(job);
+	}
+	for (int i = 0; i < count; i++) {
+		if (started[i]) pthread_join(threads[i], NULL);
+	}
+	#else
+	for (int i = 0; i < count; i++) job_fn((char *)jobs + i * job_size);
+	#endif
+}
+
+/**
+ * @brief Sorts src[lo..hi) of a SortJob in place with qsort().
+ *
+ * @param arg pointer to SortJob
+ * @return NULL
+ */
+void *sort_job(void *arg) {
+	SortJob *job = arg;
+	qsort(job -> src + job -> lo, job -> hi - job -> lo, sizeof(Student *),
+		compare_students_uncounted);
+	return NULL;
+}
+
+/**
+ * @brief Merges the sorted runs src[lo..mid) and src[mid..hi) of a SortJob into
+ * dst[lo..hi).
+ *
+ * @param arg pointer to SortJob
+ * @return NULL
+ */
+void *merge_job(void *arg) {
+	SortJob *job = arg;
+	int i = job -> lo;
+	int j = job -> mid;
+	int k = job -> lo;
+
+	while (i < job -> mid && j < job -> hi) {
+		if (order_students(job -> src[j], job -> src[i]) < 0) job -> dst[k++] = job -> src[j++];
+		else job -> dst[k++] = job -> src[i++];
+	}
+	while (i < job -> mid) job -> dst[k++] = job -> src[i++];
+	while (j < job -> hi) job -> dst[k++] = job -> src[j++];
+
+	return NULL;
+}
+
+/**
+ * @brief Sorts an array of Students by sort_students() with a parallel merge sort: the
+ * array is split into one run per worker, the runs are sorted concurrently, and then merged
+ * pairwise, the merges of each level running concurrently.
+ *
+ * @param arr array of Students
+ * @param count number of Students in arr
+ * @param workers number of threads to use
+ * @return 0 if successful, error code otherwise
+ */
+int parallel_sort(Student **arr, int count, int workers) {
+	if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+	if (workers < 2 || count < PARALLEL_MIN_RECORDS) {
+		if (count > 0) qsort(arr, count, sizeof(Student *), compare_students);
+		return 0;
+	}
+
+	Student **tmp = malloc(count * sizeof(Student *));
+	if (tmp == NULL) return ERR_MEM_ALLOC_FAIL;     // Handle alloc failure
+
+	// Run boundaries: run i is arr[bounds[i]..bounds[i + 1])
+	int bounds[MAX_WORKERS + 1];
+	for (int i = 0; i <= workers; i++) bounds[i] = (int)((long long)count * i / workers);
+
+	SortJob jobs[MAX_WORKERS];
+	for (int i = 0; i < workers; i++) {
+		jobs[i].src = arr;
+		jobs[i].lo = bounds[i];
+		jobs[i].hi = bounds[i + 1];
+	}
+	run_parallel(sort_job, jobs, sizeof(SortJob), workers);
+
+	// Merge pairs of runs until one run is left
+	Student **src = arr;
+	Student **dst = tmp;
+	for (int runs = workers; runs > 1; runs = (runs + 1) / 2) {
+		int merges = 0;
+		for (int i = 0; i < runs; i += 2) {
+			jobs[merges].src = src;
+			jobs[merges].dst = dst;
+			jobs[merges].lo = bounds[i];
+			jobs[merges].mid = bounds[(i + 1 < runs) ? i + 1 : runs];   // Odd run: copy as is
+			jobs[merges].hi = bounds[(i + 2 < runs) ? i + 2 : runs];
+			merges++;
+		}
+		run_parallel(merge_job, jobs, sizeof(SortJob), merges);
+
+		// The merged runs' boundaries are every other old boundary
+		for (int i = 0; i <= merges; i++) bounds[i] = bounds[(2 * i < runs) ? 2 * i : runs];
+
+		Student **swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if (src != arr) memcpy(arr, src, count * sizeof(Student *));
+	free(tmp);
+	return 0;
+}
+
+/**
+ * @brief Sorts the list and rebuilds its ranking tree if lazy ordering left them out of
+ * order. Takes O(n log n) time for a dirty list and nothing otherwise. Long lists are
+ * sorted with parallel_sort().
+ *
+ * @param students_head pointer to the head of the linked list
+ * @return 0 if successful, error code otherwise
+ */
+int ensure_sorted(Student *students_head) {
+	ListHead *list = list_of(students_head);
+	if (!list -> dirty) return 0;
+
+	// Every Student of the list is in the ID index
+	int count = (int)list -> id_index.count;
+	Student **sorted = malloc((count > 0 ? count : 1) * sizeof(Student *));
+	if (sorted == NULL) return ERR_MEM_ALLOC_FAIL;  // Handle alloc failure
+
+	int i = 0;
+	for (Student *s = students_head -> next; s != NULL; s = s -> next) sorted[i++] = s;
+
+	int err = parallel_sort(sorted, count, list -> workers);
+	if (err) {  // Handle error
+		free(sorted);
+		return err;
+	}
+	link_sorted(sorted, count, students_head);
+	list -> dirty = FALSE;
+
+	free(sorted);
+	return 0;
+}
+
+/**
+ * @brief Writes a non-negative integer as decimal digits. No '\0' is written.
+ *
+ * @param dest where to write the digits
+ * @param val
+ * @return pointer right after the last written digit
+ */
+char *format_uint(char *dest, unsigned int val) {
+	char digits[10];    // Enough for any unsigned int up to 32 bits
+	int n = 0;
+
+	do {
+		digits[n++] = (char)('0' + val % 10);
+		val /= 10;
+	} while (val != 0);
+
+	while (n > 0) *dest++ = digits[--n];
+	return dest;
+}
+
+/**
+ * @brief Formats the given student's information as a single line into a buffer:
+ * "<ID> <last name> <first name> <rnd1> ... <rnd6> <total>\n". No '\0' is written.
+ *
+ * @param buf where to write the line
+ * @param cap number of bytes available in buf
+ * @param student
+ * @return number of bytes written, 0 if the line might not fit in cap bytes
+ */
+size_t format_student(char *buf, size_t cap, Student *student) {
+	const char *strs[3] = {student -> student_id, student -> lastname, student -> firstname};
+	size_t lens[3];
+	for (int i = 0; i < 3; i++) lens[i] = strlen(strs[i]);
+
+	/* Points take at most 3 digits (EXCRS_PTS) and the total at most 4 (MAX_TOTAL_PTS), each
+	followed by a separator */
+	size_t max_len = lens[0] + lens[1] + lens[2] + 3 + EXCRS_RNDS * 4 + 5;
+	if (max_len > cap) return 0;
+
+	char *pos = buf;
+
+	// Student number, last name and first name
+	for (int i = 0; i < 3; i++) {
+		memcpy(pos, strs[i], lens[i]);
+		pos += lens[i];
+		*pos++ = ' ';
+	}
+
+	// Points for each round
+	for (int i = 0; i < EXCRS_RNDS; i++) {
+		pos = format_uint(pos, (unsigned int)student -> points[i]);
+		*pos++ = ' ';
+	}
+
+	// Total points
+	pos = format_uint(pos, (unsigned int)student -> total);
+	*pos++ = '\n';
+
+	return pos - buf;
+}
+
+/**
+ * @brief Prints the given student's information on a single line in the given stream.
+ *
+ * @param stream
+ * @param student
+ * @return 0 if successful, error code otherwise
+ */
+int print_to_stream(FILE *stream, Student *student) {
+	if (stream == NULL) return ERR_NULL_STRM;     // Handle error
+
+	// Format on the stack unless the names are very long
+	char line[256];
+	char *buf = line;
+	size_t len = format_student(line, sizeof(line), student);
+	if (len == 0) {
+		size_t cap = strlen(student -> lastname) + strlen(student -> firstname) + sizeof(line);
+		buf = malloc(cap);
+		if (buf == NULL) return ERR_MEM_ALLOC_FAIL;     // Handle alloc failure
+		len = format_student(buf, cap, student);
+	}
+
+	fwrite(buf, 1, len, stream);
+	STATS_ADD(run_stats.record_bytes, len);
+
+	if (buf != line) free(buf);
+	return 0;
+}
+
+/**
+ * @brief Prints at most count Students of merged linked lists into the given stream, in
+ * the order of merge_next(). Records are formatted into a buffer of FORMAT_BUFFER_SIZE,
+ * which is written out with one fwrite() whenever it fills up.
+ *
+ * @param stream
+ * @param heap runs started by merge_lists()
+ * @param count maximum number of Students to print, INT_MAX for the rest of the runs
+ * @return 0 if successful, error code otherwise
+ */
+int write_merged(FILE *stream, MergeHeap *heap, int count) {
+	if (stream == NULL) return ERR_NULL_STRM;     // Handle error
+
+	char *buf = malloc(FORMAT_BUFFER_SIZE);
+	if (buf == NULL) return ERR_MEM_ALLOC_FAIL;     // Handle alloc failure
+	size_t used = 0;
+
+	Student *curr_student;
+	for (int i = 0; i < count && (curr_student = merge_next(heap)) != NULL; i++) {
+		size_t len = format_student(buf + used, FORMAT_BUFFER_SIZE - used, curr_student);
+		if (len == 0) {     // Buffer full: write it out and try again
+			fwrite(buf, 1, used, stream);
+			STATS_ADD(run_stats.record_bytes, used);
+			used = 0;
+			len = format_student(buf, FORMAT_BUFFER_SIZE, curr_student);
+		}
+
+		if (len == 0) {     // Longer than the whole buffer
+			int err = print_to_stream(stream, curr_student);
+			if (err) {  // Handle error
+				free(buf);
+				return err;
+			}
+		}
+		used += len;
+	}
+
+	fwrite(buf, 1, used, stream);
+	STATS_ADD(run_stats.record_bytes, used);
+	free(buf);
+	return 0;
+}
+
+/**
+ * @brief Prints the given Student and at most count - 1 Students after it in the linked
+ * list into the given stream, like write_merged().
+ *
+ * @param stream
+ * @param first first Student to print, NULL prints nothing
+ * @param count maximum number of Students to print, INT_MAX for the rest of the list
+ * @return 0 if successful, error code otherwise
+ */
+int write_records(FILE *stream, Student *first, int count) {
+	MergeHeap heap;
+	merge_lists(&heap, &first, 1);
+	return write_merged(stream, &heap, count);
+}
+
+/**
+ * @brief Formats the Students of a FormatJob into the job's buffer.
+ *
+ * @param arg pointer to FormatJob
+ * @return NULL
+ */
+void *format_job(void *arg) {
+	FormatJob *job = arg;
+	Student *curr_student = job -> first;
+
+	for (int i = 0; i < job -> count; i++) {
+		if (job -> students != NULL) curr_student = job -> students[i];
+		size_t len;
+		while ((len = format_student(job -> buf + job -> len, job -> cap - job -> len,
+			curr_student)) == 0) {
+			// Grow the buffer until the record fits
+			char *new_buf = realloc(job -> buf, job -> cap * 2);
+			if (new_buf == NULL) {  // Handle alloc failure
+				job -> err = ERR_MEM_ALLOC_FAIL;
+				return NULL;
+			}
+			job -> buf = new_buf;
+			job -> cap *= 2;
+		}
+
+		job -> len += len;
+		curr_student = curr_student -> next;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Prints all Students of one or more linked lists into the given stream, merged in
+ * the order of print_status(). Long lists are formatted by the first list's worker
+ * threads: each round, every worker formats the next PARALLEL_CHUNK_RECORDS Students into
+ * its own buffer, and the buffers are then written out in order. A single list's chunks
+ * are found from its ranking tree; the chunks of merged lists are gathered into arrays as
+ * they are merged. Short lists go through write_merged().
+ *
+ * @attention The lists must be sorted, see ensure_sorted().
+ *
+ * @param stream
+ * @param heads pointers to the heads of the linked lists
+ * @param lists number of lists, at most MAX_SHARDS
+ * @return 0 if successful, error code otherwise
+ */
+int write_records_parallel(FILE *stream, Student **heads, int lists) {
+	ListHead *list = list_of(heads[0]);
+	int workers = (list -> workers > MAX_WORKERS) ? MAX_WORKERS : list -> workers;
+	int count = 0;
+	Student *firsts[MAX_SHARDS];
+	for (int i = 0; i < lists; i++) {
+		count += (int)list_of(heads[i]) -> id_index.count;
+		firsts[i] = heads[i] -> next;
+	}
+
+	MergeHeap heap;
+	merge_lists(&heap, firsts, lists);
+	if (workers < 2 || count < PARALLEL_MIN_RECORDS) {
+		return write_merged(stream, &heap, INT_MAX);
+	}
+	if (stream == NULL) return ERR_NULL_STRM;     // Handle error
+
+	FormatJob jobs[MAX_WORKERS];
+	int err = 0;
+	for (int i = 0; i < workers; i++) {
+		jobs[i].cap = FORMAT_BUFFER_SIZE;
+		jobs[i].buf = malloc(jobs[i].cap);
+		jobs[i].students = NULL;
+		if (lists > 1) jobs[i].students = malloc(PARALLEL_CHUNK_RECORDS * sizeof(Student *));
+		if (jobs[i].buf == NULL || (lists > 1 && jobs[i].students == NULL)) {
+			err = ERR_MEM_ALLOC_FAIL;   // Handle alloc failure
+		}
+	}
+
+	for (int done = 0; done < count && !err; ) {
+		// Hand the next chunks out to the workers
+		int jobs_used = 0;
+		for (; jobs_used < workers && done < count; jobs_used++) {
+			FormatJob *job = &jobs[jobs_used];
+			job -> count = (count - done < PARALLEL_CHUNK_RECORDS) ? count - done
+				: PARALLEL_CHUNK_RECORDS;
+			if (lists == 1) job -> first = tree_select(&list -> rank_tree, done);
+			else for (int i = 0; i < job -> count; i++) job -> students[i] = merge_next(&heap);
+			job -> len = 0;
+			job -> err = 0;
+			done += job -> count;
+		}
+		run_parallel(format_job, jobs, sizeof(FormatJob), jobs_used);
+
+		// Write the chunks out in order
+		for (int i = 0; i < jobs_used && !err; i++) {
+			err = jobs[i].err;
+			if (!err) fwrite(jobs[i].buf, 1, jobs[i].len, stream);
+			if (!err) STATS_ADD(run_stats.record_bytes, jobs[i].len);
+		}
+	}
+
+	for (int i = 0; i < workers; i++) {
+		free(jobs[i].buf);
+		free(jobs[i].students);
+	}
+	return err;
+}
+
+/**
+ * @brief Prints the Students in the linked list into stdout.
+ *
+ * @param students_head pointer to the head of the linked list
+ * @return 0 if successful, error code otherwise
+ */
+int print_status(Student *students_head) {
+	return print_status_to(stdout, &students_head, 1);
+}
+
+/**
+ * @brief Prints the Students of one or more linked lists into the given stream, like
+ * print_status() would print them merged into one list.
+ *
+ * @param stream
+ * @param heads pointers to the heads of the linked lists
+ * @param lists number of lists, at most MAX_SHARDS
+ * @return 0 if successful, error code otherwise
+ */
+int print_status_to(FILE *stream, Student **heads, int lists) {
+	int err = ensure_all_sorted(heads, lists);
+	if (err) return err;    // Handle error
+
+	return write_records_parallel(stream, heads, lists);
+}
+
+/**
+ * @brief Sorts every one of several linked lists, see ensure_sorted().
+ *
+ * @param heads pointers to the heads of the linked lists
+ * @param lists number of lists
+ * @return 0 if successful, error code otherwise
+ */
+int ensure_all_sorted(Student **heads, int lists) {
+	for (int i = 0; i < lists; i++) {
+		int err = ensure_sorted(heads[i]);
+		if (err) return err;    // Handle error
+	}
+	return 0;
+}
+
+/**
+ * @brief Prints the count highest ranked Students of one or more linked lists into a
+ * stream, in the same order and format as print_status(). The lists are merged, and only
+ * the first count Students of each list are visited.
+ *
+ * @param stream
+ * @param heads pointers to the heads of the linked lists
+ * @param lists number of lists, at most MAX_SHARDS
+ * @param count number of Students to print
+ * @return 0 if successful, error code otherwise
+ */
+int print_top(FILE *stream, Student **heads, int lists, int count) {
+	int err = ensure_all_sorted(heads, lists);
+	if (err) return err;    // Handle error
+
+	Student *firsts[MAX_SHARDS];
+	for (int i = 0; i < lists; i++) firsts[i] = heads[i] -> next;
+
+	MergeHeap heap;
+	merge_lists(&heap, firsts, lists);
+	return write_merged(stream, &heap, count);
+}
+
+/**
+ * @brief Prints the 1-based rank of a Student among one or more linked lists into a
+ * stream, followed by the Student's record in the format of print_status(). The Student
+ * is found from the ID index of the list that shard_of() its ID gives, and its rank is
+ * the number of Students before it in each list's ranking tree, so this takes
+ * O(lists log n) time.
+ *
+ * RANK: <rank> <ID> <lname> <fname> <rnd1> ... <rnd6> <totalpts>
+ *
+ * @param stream
+ * @param heads pointers to the heads of the linked lists
+ * @param lists number of lists
+ * @param student_id
+ * @return 0 if successful, error code otherwise
+ */
+int print_rank(FILE *stream, Student **heads, int lists, char *student_id) {
+	ListHead *owner = list_of(heads[(lists > 1) ? shard_of(student_id, lists) : 0]);
+	Student *student = id_index_find(&owner -> id_index, student_id);
+	if (student == NULL) return ERR_STDNT_NOT_FND;  // Student not found error
+
+	int err = ensure_all_sorted(heads, lists);
+	if (err) return err;    // Handle error
+
+	int rank = 1;
+	for (int i = 0; i < lists; i++) {
+		rank += tree_count_before(&list_of(heads[i]) -> rank_tree, student);
+	}
+
+	fprintf(stream, "%d ", rank);
+	return print_to_stream(stream, student);
+}
+
+/**
+ * @brief Tells if a Student has more total points than the given maximum, i.e. comes before
+ * every Student within it in the ranking order. For tree_seek().
+ *
+ * @param node
+ * @param key pointer to the maximum total (int)
+ * @return TRUE if the Student's total is above the maximum, FALSE otherwise
+ */
+int total_above(Student *node, const void *key) {
+	return node -> total > *(const int *)key;
+}
+
+/**
+ * @brief Tells if a Student has at least the given minimum of total points, i.e. comes
+ * before every Student below it in the ranking order. For tree_count_prefix().
+ *
+ * @param node
+ * @param key pointer to the minimum total (int)
+ * @return TRUE if the Student's total is at least the minimum, FALSE otherwise
+ */
+int total_at_least(Student *node, const void *key) {
+	return node -> total >= *(const int *)key;
+}
+
+/**
+ * @brief Prints the Students of one or more linked lists whose total points are between
+ * min and max (inclusive) into a stream, in the order and format of print_status(). The
+ * first match and the number of matches of each list are found from its ranking tree and
+ * the matches are merged, so this takes O(lists log n + matches log lists) time.
+ *
+ * @param stream
+ * @param heads pointers to the heads of the linked lists
+ * @param lists number of lists, at most MAX_SHARDS
+ * @param min smallest total to print
+ * @param max largest total to print
+ * @return 0 if successful, error code otherwise
+ */
+int print_range(FILE *stream, Student **heads, int lists, int min, int max) {
+	int err = ensure_all_sorted(heads, lists);
+	if (err) return err;    // Handle error
+
+	Student *firsts[MAX_SHARDS];
+	int count = 0;
+	for (int i = 0; i < lists; i++) {
+		Tree *tree = &list_of(heads[i]) -> rank_tree;
+		firsts[i] = tree_seek(tree, total_above, &max);
+
+		// Matches are the Students with at least min points that aren't above max
+		int matches = tree_count_prefix(tree, total_at_least, &min)
+			- tree_count_prefix(tree, total_above, &max);
+		if (matches > 0) count += matches;
+	}
+
+	MergeHeap heap;
+	merge_lists(&heap, firsts, lists);
+	return write_merged(stream, &heap, count);
+}
+
+/**
+ * @brief Rebuilds the name index if a load left it out of date. Takes O(n log n) time
+ * after a load and nothing otherwise.
+ *
+ * @param students_head pointer to the head of the linked list
+ * @return 0 if successful, error code otherwise
+ */
+int ensure_name_index(Student *students_head) {
+	ListHead *list = list_of(students_head);
+	if (!list -> names_stale) return 0;
+
+	int count = (int)list -> id_index.count;
+	Student **sorted = malloc((count > 0 ? count : 1) * sizeof(Student *));
+	if (sorted == NULL) return ERR_MEM_ALLOC_FAIL;  // Handle alloc failure
+
+	int i = 0;
+	for (Student *s = students_head -> next; s != NULL; s = s -> next) sorted[i++] = s;
+	qsort(sorted, count, sizeof(Student *), compare_names);
+	list -> name_index.root = tree_build(&list -> name_index, sorted, count);
+	list -> names_stale = FALSE;
+
+	free(sorted);
+	return 0;
+}
+
+/**
+ * @brief Tells where a Student is compared to the Students whose last name starts with a
+ * prefix, in the order of the name index.
+ *
+ * @param node
+ * @param key the prefix (char *)
+ * @return <0 if the Student comes before the matches, 0 if it matches, >0 if after them
+ */
+int match_name_prefix(Student *node, const void *key) {
+	const char *prefix = key;
+	return strncmp(node -> lastname, prefix, strlen(prefix));
+}
+
+/**
+ * @brief Tells if a Student comes before the Students whose last name starts with a
+ * prefix, in the order of the name index. For tree_iter_seek().
+ *
+ * @param node
+ * @param key the prefix (char *)
+ * @return TRUE if the Student comes before the matches, FALSE otherwise
+ */
+int name_before_prefix(Student *node, const void *key) {
+	return match_name_prefix(node, key) < 0;
+}
+
+/**
+ * @brief Prints the Students of one or more linked lists whose last name starts with the
+ * given prefix into a stream, ordered by last name, first name and student number, in the
+ * format of print_status(). The matches of each list are iterated from its name index and
+ * merged, in O(lists log n + matches log lists) time.
+ *
+ * @param stream
+ * @param heads pointers to the heads of the linked lists
+ * @param lists number of lists, at most MAX_SHARDS
+ * @param prefix beginning of the last name
+ * @return 0 if successful, error code otherwise
+ */
+int print_names(FILE *stream, Student **heads, int lists, char *prefix) {
+	for (int i = 0; i < lists; i++) {
+		int err = ensure_name_index(heads[i]);
+		if (err) return err;    // Handle error
+	}
+
+	TreeIter *iters = malloc(lists * sizeof(TreeIter));
+	if (iters == NULL) return ERR_MEM_ALLOC_FAIL;   // Handle alloc failure
+
+	MergeHeap heap;
+	merge_init(&heap, sort_names);
+	for (int i = 0; i < lists; i++) {
+		tree_iter_seek(&iters[i], &list_of(heads[i]) -> name_index, name_before_prefix, prefix);
+		Student *s = tree_iter_next(&iters[i]);
+		if (s != NULL && match_name_prefix(s, prefix) == 0) merge_push(&heap, s, i);
+	}
+
+	int err = 0;
+	int run;
+	Student *student;
+	while (!err && (student = merge_pop(&heap, &run)) != NULL) {
+		err = print_to_stream(stream, student);
+
+		// The matches of a list end at its first Student past them
+		Student *s = tree_iter_next(&iters[run]);
+		if (s != NULL && match_name_prefix(s, prefix) == 0) merge_push(&heap, s, run);
+	}
+
+	free(iters);
+	return err;
+}
+
+/**
+ * @brief Updates a CRC-32 (IEEE 802.3, as used by zlib) with more data. Start with crc = 0.
+ *
+ * @param crc CRC of the data so far
+ * @param data
+ * @param len
+ * @return CRC of the data so far followed by the given data
+ */
+unsigned long crc32_update(unsigned long crc, const unsigned char *data, size_t len) {
+	// Table for one nibble at a time: small enough to not need initialization at runtime
+	static const unsigned long table[16] = {
+		0x00000000UL, 0x1DB71064UL, 0x3B6E20C8UL, 0x26D930ACUL,
+		0x76DC4190UL, 0x6B6B51F4UL, 0x4DB26158UL, 0x5005713CUL,
+		0xEDB88320UL, 0xF00F9344UL, 0xD6D6A3E8UL, 0xCB61B38CUL,
+		0x9B64C2B0UL, 0x86D3D2D4UL, 0xA00AE278UL, 0xBDBDF21CUL
+	};
+
+	crc = ~crc & 0xFFFFFFFFUL;
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		crc = (crc >> 4) ^ table[crc & 0x0F];
+		crc = (crc >> 4) ^ table[crc & 0x0F];
+	}
+	return ~crc & 0xFFFFFFFFUL;
+}
+
+/**
+ * @brief Checks if the file name ends in BINARY_EXT.
+ *
+ * @param filename
+ * @return TRUE if the file should be written as a binary snapshot, FALSE otherwise
+ */
+int has_binary_ext(const char *filename) {
+	size_t len = strlen(filename);
+	size_t ext_len = strlen(BINARY_EXT);
+	return len > ext_len && strcmp(filename + len - ext_len, BINARY_EXT) == 0;
+}
+
+/**
+ * @brief Stores an unsigned integer into a buffer as little-endian.
+ *
+ * @param buf
+ * @param val
+ * @param bytes number of bytes to store (at most 4)
+ */
+void put_le(unsigned char *buf, unsigned long val, int bytes) {
+	for (int i = 0; i < bytes; i++) buf[i] = (unsigned char)(val >> (8 * i));
+}
+
+/**
+ * @brief Reads a little-endian unsigned integer from a buffer.
+ *
+ * @param buf
+ * @param bytes number of bytes to read (at most 4)
+ * @return the read integer
+ */
+unsigned long get_le(const unsigned char *buf, int bytes) {
+	unsigned long val = 0;
+	for (int i = bytes - 1; i >= 0; i--) val = (val << 8) | buf[i];
+	return val;
+}
+
+/**
+ * @brief Writes the Students of one or more linked lists into an open file as a binary
+ * snapshot, merged in the order of print_status(). See BINARY_EXT in project.h for the
+ * format.
+ *
+ * @attention The lists must be sorted, see ensure_sorted().
+ *
+ * @param file file opened for writing in binary mode
+ * @param heads pointers to the heads of the linked lists
+ * @param lists number of lists, at most MAX_SHARDS
+ * @param epoch journal epoch for the header, 0 if the file isn't a journal snapshot
+ * @return 0 if successful, error code otherwise
+ */
+int write_binary(FILE *file, Student **heads, int lists, unsigned long epoch) {
+	unsigned char buf[BINARY_HEADER_SIZE];
+	unsigned long crc = 0;
+	unsigned long count = 0;
+	unsigned long string_bytes = 0;
+	Student *firsts[MAX_SHARDS];
+	MergeHeap heap;
+	Student *s;
+
+	// First pass: sizes for the header
+	for (int i = 0; i < lists; i++) {
+		firsts[i] = heads[i] -> next;
+		for (s = firsts[i]; s != NULL; s = s -> next) {
+			count++;
+			string_bytes += 1 + strlen(s -> student_id) + 4 + strlen(s -> lastname) + 4
+				+ strlen(s -> firstname);
+		}
+	}
+
+	// Header
+	memcpy(buf, BINARY_MAGIC, 4);
+	put_le(buf + 4, BINARY_VERSION, 2);
+	put_le(buf + 6, EXCRS_RNDS, 2);
+	put_le(buf + 8, count, 4);
+	put_le(buf + 12, string_bytes, 4);
+	put_le(buf + 16, epoch, 4);
+	fwrite(buf, 1, BINARY_HEADER_SIZE, file);
+	crc = crc32_update(crc, buf, BINARY_HEADER_SIZE);
+
+	// Fixed-width points
+	merge_lists(&heap, firsts, lists);
+	while ((s = merge_next(&heap)) != NULL) {
+		unsigned char pts[2 * EXCRS_RNDS];
+		for (int i = 0; i < EXCRS_RNDS; i++) put_le(pts + 2 * i, s -> points[i], 2);
+		fwrite(pts, 1, sizeof(pts), file);
+		crc = crc32_update(crc, pts, sizeof(pts));
+	}
+
+	// Length-prefixed strings
+	merge_lists(&heap, firsts, lists);
+	while ((s = merge_next(&heap)) != NULL) {
+		const char *strs[3] = {s -> student_id, s -> lastname, s -> firstname};
+		for (int i = 0; i < 3; i++) {
+			int len_bytes = (i == 0) ? 1 : 4;   // ID length fits in one byte
+			size_t len = strlen(strs[i]);
+			put_le(buf, len, len_bytes);
+			fwrite(buf, 1, len_bytes, file);
+			fwrite(strs[i], 1, len, file);
+			crc = crc32_update(crc, buf, len_bytes);
+			crc = crc32_update(crc, (const unsigned char *)strs[i], len);
+		}
+	}
+
+	// Trailer
+	put_le(buf, crc, 4);
+	fwrite(buf, 1, BINARY_TRAILER_SIZE, file);
+
+	return ferror(file) ? ERR_FILE_WRITE : 0;
+}
+
+/**
+ * @brief Writes the Students of one or more linked lists into file, merged into one list.
+ * Assumes valid input. File names ending in BINARY_EXT get a binary snapshot, others the
+ * same format as print_status().
+ *
+ * @param filename
+ * @param heads pointers to the heads of the linked lists
+ * @param lists number of lists, at most MAX_SHARDS
+ * @return 0 if successful, error code otherwise
+ */
+int write_to_file(char *filename, Student **heads, int lists) {
+	int binary = has_binary_ext(filename);
+	int err = 0;
 
 	// Handle exception: empty list
-	if (curr_student == NULL) return ERR_WRT_EMPT_LST;
+	int empty = TRUE;
+	for (int i = 0; i < lists; i++) {
+		if (heads[i] -> next != NULL) empty = FALSE;
+	}
+	if (empty) return ERR_WRT_EMPT_LST;
+
+	err = ensure_all_sorted(heads, lists);
+	if (err) return err;    // Handle error
+
+	FILE *file = fopen(filename, binary ? "wb" : "w");
+	if (file == NULL) return ERR_FILE_OPEN;     // Handle error
+
+	if (binary) err = write_binary(file, heads, lists, 0);
+	else err = write_records_parallel(file, heads, lists);
+
+	if (fclose(file) != 0 && !err) err = ERR_FILE_WRITE;
+	return err;
+}
+
+/**
+ * @brief qsort() wrapper for sort_students(). Elements are pointers to Students.
+ *
+ * @param a pointer to pointer to Student a
+ * @param b pointer to pointer to Student b
+ * @return <0 if a before b, >0 if b before a, 0 if a and b identical
+ */
+int compare_students(const void *a, const void *b) {
+	return sort_students(*(Student * const *)a, *(Student * const *)b);
+}
+
+/**
+ * @brief qsort() wrapper for order_students(), for sorting on worker threads.
+ *
+ * @param a pointer to Student pointer
+ * @param b pointer to Student pointer
+ * @return <0 if a before b, >0 if b before a, 0 if a and b identical
+ */
+int compare_students_uncounted(const void *a, const void *b) {
+	return order_students(*(Student * const *)a, *(Student * const *)b);
+}
+
+/**
+ * @brief qsort() wrapper for sort_names(). Elements are pointers to Students.
+ *
+ * @param a pointer to Student pointer
+ * @param b pointer to Student pointer
+ * @return <0 if a before b, >0 if b before a
+ */
+int compare_names(const void *a, const void *b) {
+	return sort_names(*(Student * const *)a, *(Student * const *)b);
+}
+
+/**
+ * @brief Links an array of Students, already sorted by sort_students(), after the head of
+ * a linked list and builds the ranking tree for them in O(n). Whatever the list held
+ * before is overwritten, not free'd.
+ *
+ * @param sorted array of sorted Students
+ * @param count number of Students in the array
+ * @param students_head pointer to the head of the linked list
+ */
+void link_sorted(Student **sorted, int count, Student *students_head) {
+	Student *prev_student = students_head;
+	for (int i = 0; i < count; i++) {
+		prev_student -> next = sorted[i];
+		sorted[i] -> prev = prev_student;
+		prev_student = sorted[i];
+	}
+	prev_student -> next = NULL;
+
+	Tree *rank_tree = &list_of(students_head) -> rank_tree;
+	rank_tree -> root = tree_build(rank_tree, sorted, count);
+}
+
+/**
+ * @brief Opens a read-only view of the whole file. Uses mmap() where available, so the file
+ * is read by page faults instead of copying it through stdio buffers.
+ *
+ * @attention Use close_file_view() to release the view.
+ *
+ * @param filename
+ * @param view FileView to initialize
+ * @return 0 if successful, error code otherwise
+ */
+int open_file_view(const char *filename, FileView *view) {
+	view -> data = NULL;
+	view -> size = 0;
+	view -> mapped = FALSE;
+
+	#ifndef _WIN32
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return ERR_FILE_OPEN;   // Handle error
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+		close(fd);
+		return ERR_FILE_OPEN;
+	}
+
+	// mmap() can't map an empty file, leave data NULL instead
+	if (info.st_size > 0) {
+		void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			return ERR_FILE_OPEN;
+		}
+		posix_madvise(data, info.st_size, POSIX_MADV_SEQUENTIAL);  // Just a hint
+
+		view -> data = data;
+		view -> size = info.st_size;
+		view -> mapped = TRUE;
+	}
+
+	close(fd);  // The mapping stays valid after closing
+	return 0;
+
+	#else
+	FILE *file = fopen(filename, "rb");
+	if (file == NULL) return ERR_FILE_OPEN;     // Handle error
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size < 0) {
+		fclose(file);
+		return ERR_FILE_OPEN;
+	}
+
+	if (size > 0) {
+		char *data = malloc(size);
+		if (data == NULL) {     // Handle alloc failure
+			fclose(file);
+			return ERR_MEM_ALLOC_FAIL;
+		}
+		size = fread(data, 1, size, file);
+
+		// Drop '\r' of "\r\n" line endings, like reading in text mode would
+		long len = 0;
+		for (long i = 0; i < size; i++) {
+			if (data[i] == '\r' && i + 1 < size && data[i + 1] == '\n') continue;
+			data[len++] = data[i];
+		}
+
+		view -> data = data;
+		view -> size = len;
+	}
+
+	fclose(file);
+	return 0;
+	#endif
+}
+
+/**
+ * @brief Releases a view opened by open_file_view().
+ *
+ * @param view
+ */
+void close_file_view(FileView *view) {
+	#ifndef _WIN32
+	if (view -> mapped) munmap(view -> data, view -> size);
+	else free(view -> data);
+	#else
+	free(view -> data);
+	#endif
+
+	view -> data = NULL;
+	view -> size = 0;
+}
+
+/**
+ * @brief Makes room for at least count rows in a LoadBuffer.
+ *
+ * @param buffer
+ * @param count number of rows needed
+ * @return 0 if successful, error code otherwise
+ */
+int load_buffer_reserve(LoadBuffer *buffer, int count) {
+	if (count <= buffer -> capacity) return 0;
+
+	int new_cap = (buffer -> capacity == 0) ? 64 : buffer -> capacity * 2;
+	if (new_cap < count) new_cap = count;
+	Student **new_rows = realloc(buffer -> rows, new_cap * sizeof(Student *));
+	if (new_rows == NULL) return ERR_MEM_ALLOC_FAIL;    // Handle alloc failure
+	buffer -> rows = new_rows;
+	buffer -> capacity = new_cap;
+
+	return 0;
+}
+
+/**
+ * @brief Creates a Student from loaded fields and appends it to a LoadBuffer without
+ * checking or indexing its ID. Names are copied once, straight from the file contents.
+ *
+ * @param buffer
+ * @param student_id already validated student ID
+ * @param id_len
+ * @param lastname
+ * @param lastname_len
+ * @param firstname
+ * @param firstname_len
+ * @param points array of EXCRS_RNDS already validated round points
+ * @return 0 if successful, error code otherwise
+ */
+int load_buffer_append(LoadBuffer *buffer, const char *student_id, size_t id_len,
+	const char *lastname, size_t lastname_len, const char *firstname, size_t firstname_len,
+	const int *points) {
+	// Make room for one more row
+	int err = load_buffer_reserve(buffer, buffer -> count + 1);
+	if (err) return err;    // Handle error
+
+	// Create the Student
+	Student *new_student = init_student_n(&buffer -> pool, student_id, id_len, lastname,
+		lastname_len, firstname, firstname_len);
+	if (new_student == NULL) return ERR_MEM_ALLOC_FAIL;     // Handle alloc failure
+	buffer -> rows[buffer -> count++] = new_student;
+
+	// Set student points
+	for (int i = 0; i < EXCRS_RNDS; i++) {
+		new_student -> points[i] = points[i];
+		new_student -> total += points[i];
+	}
+	new_student -> sort_key = make_sort_key(new_student -> total, new_student -> lastname);
+
+	return 0;
+}
+
+/**
+ * @brief Creates a Student from loaded fields and appends it to a LoadBuffer. The ID must
+ * not be in the buffer yet.
+ *
+ * @param buffer
+ * @param student_id already validated student ID
+ * @param id_len
+ * @param lastname
+ * @param lastname_len
+ * @param firstname
+ * @param firstname_len
+ * @param points array of EXCRS_RNDS already validated round points
+ * @return 0 if successful, error code otherwise
+ */
+int load_buffer_add(LoadBuffer *buffer, const char *student_id, size_t id_len,
+	const char *lastname, size_t lastname_len, const char *firstname, size_t firstname_len,
+	const int *points) {
+	// Student IDs must be unique within the file
+	char id_str[STDNT_ID_LEN + 1];
+	memcpy(id_str, student_id, id_len);
+	id_str[id_len] = '\0';
+	if (id_index_find(&buffer -> index, id_str) != NULL) return ERR_FILE_CORR;
+
+	int err = load_buffer_append(buffer, id_str, id_len, lastname, lastname_len, firstname,
+		firstname_len, points);
+	if (err) return err;    // Handle error
+
+	if (id_index_insert(&buffer -> index, buffer -> rows[buffer -> count - 1])) {
+		free_student(&buffer -> pool, buffer -> rows[--buffer -> count]);
+		return ERR_MEM_ALLOC_FAIL;  // Handle alloc failure
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Frees the Students of a LoadBuffer and the buffer's own memory.
+ *
+ * @param buffer
+ */
+void load_buffer_free(LoadBuffer *buffer) {
+	pool_release(&buffer -> pool);
+	free(buffer -> rows);
+	id_index_free(&buffer -> index);
+}
+
+/**
+ * @brief Parses a text file, in the format written by print_to_stream(), into a
+ * LoadBuffer. Every line is parsed in place, so lines may be of any length.
+ *
+ * @param view contents of the file
+ * @param buffer LoadBuffer that receives the Students
+ * @return 0 if successful, error code otherwise
+ */
+int parse_text(FileView *view, LoadBuffer *buffer) {
+	const char *pos = view -> data;
+	const char *end = view -> data + view -> size;
+
+	// Keep reading lines until EOF or error
+	while (pos < end) {
+		const char *eol = memchr(pos, '\n', end - pos);
+		size_t len = (eol != NULL) ? (size_t)(eol - pos) : (size_t)(end - pos);
+
+		// Parse and validate the line
+		Span fields[MAX_ARGS];
+		int points[EXCRS_RNDS];
+		int err = parse_record(pos, len, eol != NULL, fields, points);
+		if (err) return err;    // Handle error
+
+		err = load_buffer_add(buffer, fields[0].start, fields[0].len, fields[1].start,
+			fields[1].len, fields[2].start, fields[2].len, points);
+		if (err) return err;    // Handle error
+
+		pos += len + 1;     // Move on to the next line
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Parses the lines of one ParseJob into the job's own LoadBuffer. Stops at the first
+ * bad line.
+ *
+ * @param arg pointer to ParseJob
+ * @return NULL
+ */
+void *parse_job(void *arg) {
+	ParseJob *job = arg;
+	const char *pos = job -> start;
+
+	while (pos < job -> end && !job -> err) {
+		const char *eol = memchr(pos, '\n', job -> end - pos);
+		size_t len = (eol != NULL) ? (size_t)(eol - pos) : (size_t)(job -> end - pos);
+
+		// Parse and validate the line, duplicate IDs are checked when the chunks are merged
+		Span fields[MAX_ARGS];
+		int points[EXCRS_RNDS];
+		job -> err = parse_record(pos, len, eol != NULL, fields, points);
+		if (!job -> err) {
+			job -> err = load_buffer_append(&job -> buffer, fields[0].start, fields[0].len,
+				fields[1].start, fields[1].len, fields[2].start, fields[2].len, points);
+		}
+
+		pos += len + 1;     // Move on to the next line
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Parses a text file into a LoadBuffer like parse_text(), but on worker threads. The
+ * file is split into one chunk per worker at line boundaries and the chunks are parsed
+ * concurrently. The results are then merged in file order, which is also when duplicate
+ * IDs are found, so the error reported is always the one of the first bad line, as with
+ * parse_text(). Small files go through parse_text().
+ *
+ * @param view contents of the file
+ * @param buffer LoadBuffer that receives the Students
+ * @param workers number of threads to use
+ * @return 0 if successful, error code otherwise
+ */
+int parse_text_parallel(FileView *view, LoadBuffer *buffer, int workers) {
+	if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+	if (workers < 2 || view -> size < PARALLEL_MIN_BYTES) return parse_text(view, buffer);
+
+	const char *end = view -> data + view -> size;
+	const char *pos = view -> data;
+	ParseJob jobs[MAX_WORKERS];
+
+	// Split the file into chunks that end after a newline
+	for (int i = 0; i < workers; i++) {
+		const char *cut = view -> data + view -> size / workers * (i + 1);
+		if (cut < pos) cut = pos;
+		if (cut < end) {
+			const char *eol = memchr(cut, '\n', end - cut);
+			cut = (eol != NULL) ? eol + 1 : end;
+		}
+
+		jobs[i].start = pos;
+		jobs[i].end = (i == workers - 1) ? end : cut;
+		jobs[i].buffer = (LoadBuffer){NULL, 0, 0, {NULL, 0, 0}, {NULL, NULL, NULL}};
+		jobs[i].err = 0;
+		pos = jobs[i].end;
+	}
+	run_parallel(parse_job, jobs, sizeof(ParseJob), workers);
+
+	// All Students go to the buffer's pool, so load_buffer_free() releases them on error
+	int total = 0;
+	for (int i = 0; i < workers; i++) {
+		pool_merge(&buffer -> pool, &jobs[i].buffer.pool);
+		total += jobs[i].buffer.count;
+	}
+	int err = load_buffer_reserve(buffer, total);
+
+	// Merge the chunks in file order, up to the first bad line
+	for (int i = 0; i < workers; i++) {
+		LoadBuffer *chunk = &jobs[i].buffer;
+
+		for (int j = 0; j < chunk -> count && !err; j++) {
+			Student *student = chunk -> rows[j];
+			if (id_index_find(&buffer -> index, student -> student_id) != NULL) {
+				err = ERR_FILE_CORR;    // Student IDs must be unique within the file
+			}
+			else if (id_index_insert(&buffer -> index, student)) err = ERR_MEM_ALLOC_FAIL;
+			else buffer -> rows[buffer -> count++] = student;
+		}
+		if (!err) err = jobs[i].err;
+
+		free(chunk -> rows);
+	}
+
+	return err;
+}
+
+/**
+ * @brief Checks that a name read from a binary snapshot could also be saved as text.
+ *
+ * @param name
+ * @param len
+ * @return TRUE if the name is valid, FALSE otherwise
+ */
+int valid_binary_name(const char *name, size_t len) {
+	if (len == 0) return FALSE;
+	for (size_t i = 0; i < len; i++) {
+		if (name[i] == ' ' || name[i] == '\n' || name[i] == '\0') return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * @brief Parses a binary snapshot, written by write_binary(), into a LoadBuffer. The
+ * checksum and section sizes are verified before any field is parsed.
+ *
+ * @param view contents of the file
+ * @param buffer LoadBuffer that receives the Students
+ * @return 0 if successful, error code otherwise
+ */
+int parse_binary(FileView *view, LoadBuffer *buffer) {
+	const unsigned char *data = (const unsigned char *)view -> data;
+	size_t size = view -> size;
+
+	if (size < BINARY_V1_HEADER_SIZE + BINARY_TRAILER_SIZE) return ERR_FILE_CORR;
+
+	// Checksum covers everything before the trailer
+	size_t body = size - BINARY_TRAILER_SIZE;
+	if (crc32_update(0, data, body) != get_le(data + body, 4)) return ERR_FILE_CRC;
+
+	// Header
+	unsigned long version = get_le(data + 4, 2);
+	size_t header_size = (version == 1) ? BINARY_V1_HEADER_SIZE : BINARY_HEADER_SIZE;
+	if (version != 1 && version != BINARY_VERSION) return ERR_FILE_CORR;
+	if (body < header_size) return ERR_FILE_CORR;
+	if (get_le(data + 6, 2) != EXCRS_RNDS) return ERR_FILE_CORR;
+	unsigned long count = get_le(data + 8, 4);
+	unsigned long string_bytes = get_le(data + 12, 4);
+	if (count > INT_MAX) return ERR_FILE_CORR;
+
+	// Section sizes must add up to the file size
+	size_t points_bytes = (size_t)count * EXCRS_RNDS * 2;
+	if (header_size + points_bytes + string_bytes != body) return ERR_FILE_CORR;
+
+	const unsigned char *pts = data + header_size;
+	const unsigned char *str = pts + points_bytes;
+	const unsigned char *str_end = str + string_bytes;
+
+	for (unsigned long n = 0; n < count; n++) {
+		// Points
+		int points[EXCRS_RNDS];
+		for (int i = 0; i < EXCRS_RNDS; i++, pts += 2) {
+			points[i] = (int)get_le(pts, 2);
+			if (points[i] > EXCRS_PTS) return ERR_FILE_CORR;
+		}
+
+		// Strings: ID, last name, first name
+		const char *fields[3];
+		size_t lens[3];
+		for (int i = 0; i < 3; i++) {
+			int len_bytes = (i == 0) ? 1 : 4;
+			if ((size_t)(str_end - str) < (size_t)len_bytes) return ERR_FILE_CORR;
+			lens[i] = get_le(str, len_bytes);
+			str += len_bytes;
+			if ((size_t)(str_end - str) < lens[i]) return ERR_FILE_CORR;
+			fields[i] = (const char *)str;
+			str += lens[i];
+		}
+
+		if (validate_id_span(fields[0], lens[0])) return ERR_FILE_CORR;
+		if (!valid_binary_name(fields[1], lens[1]) || !valid_binary_name(fields[2], lens[2])) {
+			return ERR_FILE_CORR;
+		}
+
+		int err = load_buffer_add(buffer, fields[0], lens[0], fields[1], lens[1], fields[2],
+			lens[2], points);
+		if (err) return err;    // Handle error
+	}
+
+	return (str == str_end) ? 0 : ERR_FILE_CORR;
+}
+
+/**
+ * @brief Loads file contents into memory. Rewrites the old linked list if file could be
+ * read successfully. Leaves the old linked list intact if loading fails. Assumes valid
+ * input.
+ *
+ * The file is viewed as a whole (memory-mapped where possible) and parsed in place, either
+ * as text or, if it starts with BINARY_MAGIC, as a binary snapshot. Large text files are
+ * parsed on the list's worker threads. The loaded Students are kept in a flat array, which is
+ * sorted once (unless already in order) and then linked into the list in one pass.
+ *
+ * @param filename
+ * @param students_head
+ * @return 0 if successful, error code otherwise
+ */
+int load_file(char *filename, Student *students_head) {
+	ListHead *list = list_of(students_head);
+	FileView view;
+	int err = open_file_view(filename, &view);
+	if (err) return err;    // Handle error
+
+	LoadBuffer buffer = {NULL, 0, 0, {NULL, 0, 0}, {NULL, NULL, NULL}};
+	if (view.size >= 4 && memcmp(view.data, BINARY_MAGIC, 4) == 0) {
+		err = parse_binary(&view, &buffer);
+	}
+	else err = parse_text_parallel(&view, &buffer, list -> workers);
+
+	close_file_view(&view);
+
+	// Files written by this program are already sorted, only sort if needed
+	for (int i = 1; i < buffer.count && !err; i++) {
+		if (sort_students(buffer.rows[i - 1], buffer.rows[i]) > 0) {
+			err = parallel_sort(buffer.rows, buffer.count, list -> workers);
+			break;
+		}
+	}
+
+	/* The journal can't describe a load: start it over from the loaded list before that
+	replaces the old one, so that an error leaves the list and journal as they were. The
+	Students are chained by their "next" pointers for this, which is all a snapshot reads
+	of the list; link_sorted() links them properly below. */
+	if (!err && list -> journal != NULL) {
+		Student loaded;
+		loaded.next = (buffer.count > 0) ? buffer.rows[0] : NULL;
+		for (int i = 0; i < buffer.count; i++) {
+			buffer.rows[i] -> next = (i + 1 < buffer.count) ? buffer.rows[i + 1] : NULL;
+		}
+		err = journal_rotate(list -> journal, &loaded);
+	}
+
+	// Start terminating procedure if an error occurred
+	if (err) {
+		load_buffer_free(&buffer);
+		return err;
+	}
+
+	// Replace the old list with the loaded one, releasing the old pool as a whole
+	pool_release(&list -> pool);
+	list -> pool = buffer.pool;
+	id_index_free(&list -> id_index);
+	list -> id_index = buffer.index;
+	list -> dirty = FALSE;
+	link_sorted(buffer.rows, buffer.count, students_head);
+	list -> name_index.root = NULL;     // Rebuilt when it is needed next
+	list -> names_stale = TRUE;
+
+	free(buffer.rows);
+	return 0;
+}
+
+/**
+ * @brief Parses and validates every line of a batch update file. Nothing is changed yet.
+ * Each Student is looked up in the list that shard_of() its ID gives.
+ *
+ * BATCH FILE: <ID> <round> <points>
+ *
+ * @param view contents of the file
+ * @param heads pointers to the heads of the linked lists, NULL for a list that must not
+ * change: a change to it makes the file invalid
+ * @param lists number of lists
+ * @param changes receives an array of the changes in file order, to be free'd by the caller
+ * @param count receives the number of changes
+ * @return 0 if successful, error code otherwise
+ */
+int parse_point_changes(FileView *view, Student **heads, int lists, PointChange **changes,
+	int *count) {
+	const char *pos = view -> data;
+	const char *end = view -> data + view -> size;
+	int capacity = 0;
+	*changes = NULL;
+	*count = 0;
+
+	while (pos < end) {
+		const char *eol = memchr(pos, '\n', end - pos);
+		size_t len = (eol != NULL) ? (size_t)(eol - pos) : (size_t)(end - pos);
+
+		// Same rules as U: valid ID of a Student in the list, round and points in bounds
+		Span fields[BATCH_FIELDS];
+		char id_str[STDNT_ID_LEN + 1];
+		if (split_span(pos, len, fields, BATCH_FIELDS) != BATCH_FIELDS) return ERR_FILE_CORR;
+		if (validate_id_span(fields[0].start, fields[0].len)) return ERR_FILE_CORR;
+		memcpy(id_str, fields[0].start, fields[0].len);
+		id_str[fields[0].len] = '\0';
+
+		int round = parse_points_span(fields[1].start, fields[1].len);
+		int points = parse_points_span(fields[2].start, fields[2].len);
+		if (round < 1 || round > EXCRS_RNDS || points < 0) return ERR_FILE_CORR;
+
+		int list = (lists > 1) ? shard_of(id_str, lists) : 0;
+		if (heads[list] == NULL) return ERR_FILE_CORR;
+		Student *student = id_index_find(&list_of(heads[list]) -> id_index, id_str);
+		if (student == NULL) return ERR_STDNT_NOT_FND;  // Student not found error
+
+		// Make room for one more change
+		if (*count == capacity) {
+			capacity = (capacity == 0) ? 64 : capacity * 2;
+			PointChange *new_changes = realloc(*changes, capacity * sizeof(PointChange));
+			if (new_changes == NULL) return ERR_MEM_ALLOC_FAIL;     // Handle alloc failure
+			*changes = new_changes;
+		}
+		(*changes)[(*count)++] = (PointChange){student, list, round, points};
+
+		pos += len + 1;     // Move on to the next line
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Applies a file of point changes as one operation. Every line is validated before
+ * anything changes, so on error the lists are left as they were. Each affected Student is
+ * taken out of its list and ranking tree once, all of its changes are applied, and it is
+ * put back once, so k changes cost O(k log n) however they are spread. In lazy ordering
+ * mode the lists are only marked out of order. A list split into shards is changed shard
+ * by shard, without merging it.
+ *
+ * @param filename
+ * @param heads pointers to the heads of the linked lists, see parse_point_changes()
+ * @param lists number of lists
+ * @return 0 if successful, error code otherwise
+ */
+int batch_update(char *filename, Student **heads, int lists) {
+	FileView view;
+	int err = open_file_view(filename, &view);
+	if (err) return err;    // Handle error
+
+	PointChange *changes;
+	int count;
+	err = parse_point_changes(&view, heads, lists, &changes, &count);
+	close_file_view(&view);
+	if (err) {  // Handle error
+		free(changes);
+		return err;
+	}
+
+	// Take out every affected Student once (a removed Student has no prev)
+	for (int i = 0; i < count; i++) {
+		Student *student = changes[i].student;
+		Student *students_head = heads[changes[i].list];
+		if (!list_of(students_head) -> lazy && student -> prev != NULL) {
+			remove_from_list(student, students_head);
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		set_round_points(changes[i].student, changes[i].round, changes[i].points);
+	}
+
+	// Put them back once, with their final points
+	for (int i = 0; i < count; i++) {
+		Student *student = changes[i].student;
+		Student *students_head = heads[changes[i].list];
+		if (list_of(students_head) -> lazy) list_of(students_head) -> dirty = TRUE;
+		else if (student -> prev == NULL) place_into_list(student, students_head);
+	}
+
+	// Journal the changes as UPDATEs once the lists are whole again
+	for (int i = 0; i < count && !err; i++) {
+		char round[12];
+		char points[12];
+		sprintf(round, "%d", changes[i].round);
+		sprintf(points, "%d", changes[i].points);
+		err = journal_record(heads[changes[i].list], UPDATE,
+			changes[i].student -> student_id, round, points);
+	}
+
+	free(changes);
+	return err;
+}
+
+/**
+ * @brief Returns the time from a monotonic clock, with nanosecond resolution where
+ * available.
+ *
+ * @return time in nanoseconds from an unspecified starting point
+ */
+long long monotonic_ns(void) {
+	#ifndef _WIN32
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000000 + now.tv_nsec;
+	#else
+	return (long long)clock() * (1000000000 / CLOCKS_PER_SEC);
+	#endif
+}
+
+/**
+ * @brief Returns the time from a monotonic clock.
+ *
+ * @return time in milliseconds from an unspecified starting point
+ */
+long long monotonic_ms(void) {
+	return monotonic_ns() / 1000000;
+}
+
+/**
+ * @brief Flushes a stream and makes the OS write the file's contents to disk.
+ *
+ * @param file
+ * @return 0 if successful, ERR_JOURNAL_WRITE otherwise
+ */
+int sync_file(FILE *file) {
+	if (fflush(file) != 0) return ERR_JOURNAL_WRITE;
+
+	#ifndef _WIN32
+	if (fsync(fileno(file)) != 0) return ERR_JOURNAL_WRITE;
+	#else
+	if (_commit(_fileno(file)) != 0) return ERR_JOURNAL_WRITE;
+	#endif
+
+	return 0;
+}
+
+/**
+ * @brief Makes the OS write the directory entries of the directory that contains a file to
+ * disk, so that a rename() into it survives a crash.
+ *
+ * @param path file name in the directory
+ * @return 0 if successful, ERR_JOURNAL_WRITE otherwise
+ */
+int sync_dir(const char *path) {
+	#ifndef _WIN32
+	const char *slash = strrchr(path, '/');
+	size_t len = (slash == NULL) ? 0 : (size_t)(slash - path) + 1;
+	char *dir = malloc(len + 2);
+	if (dir == NULL) return ERR_MEM_ALLOC_FAIL;     // Handle alloc failure
+	memcpy(dir, path, len);
+	strcpy(dir + len, ".");
+
+	int fd = open(dir, O_RDONLY);
+	free(dir);
+	if (fd < 0) return ERR_JOURNAL_WRITE;   // Handle error
+	int err = (fsync(fd) != 0) ? ERR_JOURNAL_WRITE : 0;
+	close(fd);
+	return err;
+	#else
+	(void)path;     // Windows has no directory sync
+	return 0;
+	#endif
+}
+
+/**
+ * @brief Syncs the pending records of a journal to disk.
+ *
+ * @param journal journal, may be NULL
+ * @return 0 if successful, error code otherwise
+ */
+int journal_sync(Journal *journal) {
+	if (journal == NULL || journal -> pending == 0) return 0;
+	if (journal -> file == NULL) return ERR_JOURNAL_WRITE;
+
+	journal -> pending = 0;
+	return sync_file(journal -> file);
+}
+
+/**
+ * @brief Syncs the pending records of a journal if the oldest of them has waited for
+ * JOURNAL_SYNC_MS. Called between commands to close the group commit time window.
+ *
+ * @param journal journal, may be NULL
+ * @return 0 if successful, error code otherwise
+ */
+int journal_tick(Journal *journal) {
+	if (journal == NULL || journal -> pending == 0) return 0;
+	if (monotonic_ms() - journal -> pending_since < JOURNAL_SYNC_MS) return 0;
+
+	return journal_sync(journal);
+}
+
+/**
+ * @brief Compacts the journal: writes the whole list as a new binary snapshot of the next
+ * epoch and starts the journal over empty in that epoch, see journal_rotate().
+ *
+ * @param students_head pointer to the head of the linked list, must have a journal
+ * @return 0 if successful, error code if nothing changed
+ */
+int journal_compact(Student *students_head) {
+	int err = ensure_sorted(students_head);
+	if (err) return err;    // Handle error
+
+	return journal_rotate(list_of(students_head) -> journal, students_head);
+}
+
+/**
+ * @brief Writes a sorted list as the binary snapshot of the journal's next epoch and
+ * starts the journal over empty in that epoch. Both the snapshot and the new journal are
+ * written into temporary files and synced first; renaming the snapshot over the old one
+ * is then the single point where the new epoch takes over, so a crash or error before it
+ * leaves the old snapshot and journal in place and in use.
+ *
+ * A crash after the rename but before the journal is started over leaves a journal of the
+ * previous epoch next to the new snapshot. journal_replay() skips it: the snapshot already
+ * holds its changes, or replaced them in case of a LOAD. An error at that point can't be
+ * undone either, so the journal is closed instead and the next change fails with
+ * ERR_JOURNAL_WRITE.
+ *
+ * @param journal
+ * @param students_head head of the list; only its and the Students' "next" pointers are
+ * read, so a list that isn't in place yet can be written
+ * @return 0 if the new epoch took over, ERR_JOURNAL_WRITE if nothing changed
+ */
+int journal_rotate(Journal *journal, Student *students_head) {
+	unsigned long epoch = (journal -> epoch + 1) & 0xFFFFFFFFUL;
+
+	// Write the new snapshot
+	int err = 0;
+	FILE *file = fopen(journal -> temp_path, "wb");
+	if (file == NULL) return ERR_JOURNAL_WRITE;     // Handle error
+	err = write_binary(file, &students_head, 1, epoch);
+	if (!err) err = sync_file(file);
+	if (fclose(file) != 0) err = ERR_JOURNAL_WRITE;
+
+	// Write the new journal, empty but for its header
+	FILE *restart = err ? NULL : fopen(journal -> restart_path, "w");
+	if (restart == NULL || fprintf(restart, "%c %lu\n", JOURNAL_EPOCH, epoch) < 0
+		|| sync_file(restart)) err = ERR_JOURNAL_WRITE;
+
+	// Swap the snapshot in
+	#ifdef _WIN32
+	if (!err) remove(journal -> snapshot_path);     // rename() doesn't replace on Windows
+	#endif
+	if (!err && rename(journal -> temp_path, journal -> snapshot_path) != 0) {
+		err = ERR_JOURNAL_WRITE;
+	}
+	if (err) {  // Handle error
+		if (restart != NULL) fclose(restart);
+		remove(journal -> temp_path);
+		remove(journal -> restart_path);
+		return ERR_JOURNAL_WRITE;
+	}
+
+	// The new epoch has taken over: records of the old one are no longer replayed
+	journal -> epoch = epoch;
+	if (journal -> file != NULL) fclose(journal -> file);
+	journal -> file = NULL;
+	journal -> pending = 0;
+	journal -> records = 0;
+
+	// Records of the new epoch must not reach the disk before its snapshot does
+	#ifdef _WIN32
+	remove(journal -> path);
+	#endif
+	if (sync_dir(journal -> snapshot_path) || rename(journal -> restart_path, journal -> path)) {
+		fclose(restart);    // Handle error: journal closed, see above
+		remove(journal -> restart_path);
+	}
+	else journal -> file = restart;
+
+	return 0;
+}
+
+/**
+ * @brief Appends a successful change to the list's journal, if it has one. The record is
+ * synced when JOURNAL_SYNC_RECORDS records are pending or the oldest of them has waited for
+ * JOURNAL_SYNC_MS, and the journal is compacted once it has as many records as the list
+ * has Students (but at least JOURNAL_COMPACT_MIN), which keeps the cost of a change
+ * independent of the size of the list.
+ *
+ * JOURNAL: <JOURNAL_EPOCH> <epoch>, then one record per line:
+ * <command> <student ID> <arg1> <arg2>
+ *
+ * @param students_head pointer to the head of the linked list
+ * @param command ADD or UPDATE
+ * @param student_id
+ * @param arg1 last name for ADD, round for UPDATE
+ * @param arg2 first name for ADD, points for UPDATE
+ * @return 0 if successful, ERR_JOURNAL_WRITE if the change could not be recorded
+ */
+int journal_record(Student *students_head, char command, const char *student_id,
+	const char *arg1, const char *arg2) {
+	ListHead *list = list_of(students_head);
+	Journal *journal = list -> journal;
+	if (journal == NULL) return 0;
+
+	if (journal -> file == NULL) return ERR_JOURNAL_WRITE;  // Handle earlier error
+	if (fprintf(journal -> file, "%c %s %s %s\n", command, student_id, arg1, arg2) < 0) {
+		return ERR_JOURNAL_WRITE;   // Handle error
+	}
+	if (journal -> pending++ == 0) journal -> pending_since = monotonic_ms();
+	journal -> records++;
+
+	// A failed compaction changes nothing: the record stays in the journal, and the
+	// compaction is tried again after the next one
+	if (journal -> records >= JOURNAL_COMPACT_MIN
+		&& journal -> records >= (long)list -> id_index.count
+		&& journal_compact(students_head) == 0) return 0;
+	if (journal -> pending >= JOURNAL_SYNC_RECORDS) return journal_sync(journal);
+	return journal_tick(journal);
+}
+
+/**
+ * @brief Reads the journal epoch from the header of a binary snapshot file.
+ *
+ * @param filename
+ * @param epoch receives the epoch, 0 for files without one
+ * @return 0 if successful, error code otherwise
+ */
+int read_binary_epoch(const char *filename, unsigned long *epoch) {
+	FILE *file = fopen(filename, "rb");
+	if (file == NULL) return ERR_FILE_OPEN;     // Handle error
+
+	unsigned char buf[BINARY_HEADER_SIZE];
+	size_t size = fread(buf, 1, BINARY_HEADER_SIZE, file);
+	fclose(file);
+
+	*epoch = 0;
+	if (size < BINARY_V1_HEADER_SIZE || memcmp(buf, BINARY_MAGIC, 4) != 0) {
+		return ERR_FILE_CORR;
+	}
+	if (get_le(buf + 4, 2) == 1) return 0;  // No epoch yet
+	if (size < BINARY_HEADER_SIZE) return ERR_FILE_CORR;
+
+	*epoch = get_le(buf + 16, 4);
+	return 0;
+}
+
+/**
+ * @brief Replays the records of a journal file onto the list. A last line without newline
+ * was cut short by a crash and is ignored. Records are replayed as if they were commands,
+ * except that an ADD of a Student already in the list is skipped: that record is already
+ * part of the snapshot the list was loaded from.
+ *
+ * A journal of an earlier epoch than the snapshot was left behind by a crash during
+ * journal_compact() and is skipped as a whole.
+ *
+ * @attention The list must not have a journal attached while replaying.
+ *
+ * @param students_head pointer to the head of the linked list
+ * @param path file name of the journal
+ * @param epoch epoch of the snapshot the list was loaded from
+ * @return 0 if successful (also if there is no journal file), error code otherwise
+ */
+int journal_replay(Student *students_head, const char *path, unsigned long epoch) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) return 0;     // No journal yet
+
+	LineReader reader;
+	int err = line_reader_init(&reader, file);
+	char *line = err ? NULL : read_line(&reader);
+
+	// Header; a journal cut short before its header was synced has no records either
+	if (line != NULL && line[strlen(line) - 1] == '\n') {
+		char *end = line;
+		unsigned long journal_epoch = (line[0] == JOURNAL_EPOCH && line[1] == ' ')
+			? strtoul(line + 2, &end, 10) : 0;
+		if (line[0] != JOURNAL_EPOCH || *end != '\n' || journal_epoch > epoch) {
+			err = ERR_FILE_CORR;
+		}
+		if (journal_epoch < epoch) line = NULL;     // Left behind by a crash
+	}
+	else line = NULL;
+
+	while (!err && line != NULL && (line = read_line(&reader)) != NULL) {
+		if (line[strlen(line) - 1] != '\n') break;     // Cut short by a crash
+
+		Input parsed_inp;
+		err = parse_input(line, &parsed_inp, TRUE);
+		if (!err) err = validate_input(&parsed_inp);
+		if (err) {  // Handle error
+			err = ERR_FILE_CORR;
+			break;
+		}
+
+		char **arg_arr = parsed_inp.arg_arr;
+		if (parsed_inp.cmnd == ADD) {
+			err = add_student(arg_arr[1], arg_arr[2], arg_arr[3], students_head);
+			if (err == ERR_STDNT_IN_LIST) err = 0;
+		}
+		else if (parsed_inp.cmnd == UPDATE) {
+			err = update_points(arg_arr[1], arg_arr[2], arg_arr[3], students_head);
+			if (err == ERR_UPD_PTS_ON_EMPT || err == ERR_STDNT_NOT_FND) err = ERR_FILE_CORR;
+		}
+		else err = ERR_FILE_CORR;
+	}
+
+	if (reader.buf != NULL) line_reader_free(&reader);
+	fclose(file);
+	return err;
+}
+
+/**
+ * @brief Attaches a journal to an empty list. Loads the last snapshot, if there is one,
+ * replays the journal on top of it and compacts the result into a new snapshot, so the
+ * journal starts out empty.
+ *
+ * @param students_head pointer to the head of the linked list
+ * @param path file name of the journal, the snapshot is kept next to it
+ * @return 0 if successful, error code otherwise
+ */
+int journal_open(Student *students_head, const char *path) {
+	Journal *journal = malloc(sizeof(Journal));
+	if (journal == NULL) return ERR_MEM_ALLOC_FAIL;     // Handle alloc failure
+
+	size_t len = strlen(path);
+	size_t ext_len = strlen(BINARY_EXT);
+	journal -> file = NULL;
+	journal -> path = malloc(len + 1);
+	journal -> snapshot_path = malloc(len + ext_len + 1);
+	journal -> temp_path = malloc(len + ext_len + strlen(JOURNAL_TEMP_EXT) + 1);
+	journal -> restart_path = malloc(len + strlen(JOURNAL_TEMP_EXT) + 1);
+	journal -> pending = 0;
+	journal -> pending_since = 0;
+	journal -> records = 0;
+	journal -> epoch = 0;
+	if (journal -> path == NULL || journal -> snapshot_path == NULL
+		|| journal -> temp_path == NULL || journal -> restart_path == NULL) {
+		journal_close(journal);
+		return ERR_MEM_ALLOC_FAIL;  // Handle alloc failure
+	}
+	strcpy(journal -> path, path);
+	strcpy(journal -> snapshot_path, path);
+	strcat(journal -> snapshot_path, BINARY_EXT);
+	strcpy(journal -> temp_path, journal -> snapshot_path);
+	strcat(journal -> temp_path, JOURNAL_TEMP_EXT);
+	strcpy(journal -> restart_path, path);
+	strcat(journal -> restart_path, JOURNAL_TEMP_EXT);
+
+	// Start from the last snapshot, if there is one
+	int err = 0;
+	FILE *snapshot = fopen(journal -> snapshot_path, "rb");
+	if (snapshot != NULL) {
+		fclose(snapshot);
+		err = read_binary_epoch(journal -> snapshot_path, &journal -> epoch);
+		if (!err) err = load_file(journal -> snapshot_path, students_head);
+	}
+
+	if (!err) err = journal_replay(students_head, journal -> path, journal -> epoch);
+
+	list_of(students_head) -> journal = journal;
+	if (!err) err = journal_compact(students_head);
+	if (err) {  // Handle error
+		list_of(students_head) -> journal = NULL;
+		journal_close(journal);
+	}
+
+	return err;
+}
+
+/**
+ * @brief Syncs the pending records of a journal and frees it.
+ *
+ * @param journal
+ */
+void journal_close(Journal *journal) {
+	journal_sync(journal);
+	if (journal -> file != NULL) fclose(journal -> file);
+	free(journal -> path);
+	free(journal -> snapshot_path);
+	free(journal -> temp_path);
+	free(journal -> restart_path);
+	free(journal);
+}
+
+/**
+ * @brief Attempt to run the user given command.
+ *
+ * @param input modifiable user input string
+ * @param students_head pointer to the head of the linked list
+ * @return 0 if successful, 1 if QUIT command given, error code if unsuccessful
+ */
+int run(char *input, Student *students_head) {
+	return run_command(input, students_head, stdout);
+}
+
+/**
+ * @brief Attempt to run the user given command like run(), printing the command's output
+ * into the given stream instead of stdout.
+ *
+ * @param input modifiable user input string
+ * @param students_head pointer to the head of the linked list
+ * @param stream stream for the output of the command
+ * @return 0 if successful, 1 if QUIT command given, error code if unsuccessful
+ */
+int run_command(char *input, Student *students_head, FILE *stream) {
+	return run_command_on(input, &students_head, 1, stream);
+}
+
+/**
+ * @brief Attempt to run the user given command like run_command(), on a list that is split
+ * into several linked lists by shard_of() the student IDs. Only BATCH and the commands
+ * that don't change the list can run on more than one list; they work as if the lists
+ * were one.
+ *
+ * @param input modifiable user input string
+ * @param heads pointers to the heads of the linked lists
+ * @param lists number of lists, 1 to MAX_SHARDS
+ * @param stream stream for the output of the command
+ * @return 0 if successful, 1 if QUIT command given, error code if unsuccessful
+ */
+int run_command_on(char *input, Student **heads, int lists, FILE *stream) {
+	Student *students_head = heads[0];
+	Input parsed_inp;   // Arguments point into the input string
+	long long start = monotonic_ns();
+
+	// Parse the user's input
+	int err = parse_input(input, &parsed_inp, TRUE);
+
+	/* =====================================================================================
+	Handles a special case to meet project requirements. This error code is only used to
+	print: "Invalid command <command char>\n" into stdout. Otherwise unnecessary and only
+	serves to make code less readable.*/
+	if (err == ERR_INV_CMND_CHAR) {
+		fprintf(stream, "Invalid command %c\n", parsed_inp.cmnd);
+		count_error(err);
+		return 0; // 0 return fools normal error detection to prevent another error printout
+	}
+	// =====================================================================================
+
+	// Back to normal error handling
+	if (err) return count_error(err);
+
+	// Validate the user's input
+	err = validate_input(&parsed_inp);
+	if (err) return count_error(err);   // Return error code
+
+	// Both of these are just for shorthand
+	char command = parsed_inp.cmnd;
+	char **arg_arr = parsed_inp.arg_arr;
+
+	// Other changes need the whole list in one
+	if (lists > 1 && (command == ADD || command == UPDATE || command == LOAD)) {
+		return count_error(ERR_UNKNOWN);
+	}
+
+	switch(command) {
+		case ADD:       // ADD: <'A'> <student ID> <last name> <first name>
+			err = add_student(arg_arr[1], arg_arr[2], arg_arr[3], students_head);
+			if (!err) fputs("SUCCESS\n", stream);
+			break;
+
+		case UPDATE:    // UPDATE: <'U'> <student ID> <round> <points>
+			err = update_points(arg_arr[1], arg_arr[2], arg_arr[3], students_head);
+			if (!err) fputs("SUCCESS\n", stream);
+			break;
+
+		case LIST:      // LIST: <'L'>
+			err = print_status_to(stream, heads, lists);
+			if (!err) fputs("SUCCESS\n", stream);
+			break;
+
+		case WRITE:     // WRITE: <'W'> <file name>
+			err = write_to_file(arg_arr[1], heads, lists);
+			if (!err) fputs("SUCCESS\n", stream);
+			break;
+
+		case LOAD:      // LOAD: <'O'> <file name>
+			err = load_file(arg_arr[1], students_head);
+			if (!err) fputs("SUCCESS\n", stream);
+			break;
+
+		case QUIT:      // QUIT: <'Q'>
+			err = QUIT_FLAG;
+			fputs("SUCCESS\n", stream);
+			break;
+
+		case STATS:     // STATS: <'S'>
+			print_stats(stream, heads, lists);
+			fputs("SUCCESS\n", stream);
+			break;
+
+		case TOP:       // TOP: <'T'> <count>
+			err = print_top(stream, heads, lists, atoi(arg_arr[1]));
+			if (!err) fputs("SUCCESS\n", stream);
+			break;
+
+		case RANK:      // RANK: <'R'> <student ID>
+			err = print_rank(stream, heads, lists, arg_arr[1]);
+			if (!err) fputs("SUCCESS\n", stream);
+			break;
+
+		case RANGE:     // RANGE: <'P'> <min total> <max total>
+			err = print_range(stream, heads, lists, atoi(arg_arr[1]),
+				atoi(arg_arr[2]));
+			if (!err) fputs("SUCCESS\n", stream);
+			break;
+
+		case NAME:      // NAME: <'N'> <last name prefix>
+			err = print_names(stream, heads, lists, arg_arr[1]);
+			if (!err) fputs("SUCCESS\n", stream);
+			break;
+
+		case BATCH:     // BATCH: <'B'> <file name>
+			err = batch_update(arg_arr[1], heads, lists);
+			if (!err) fputs("SUCCESS\n", stream);
+			break;
+
+		default:        // Should never happen due to other checks
+			err = ERR_UNKNOWN;
+			break;
+	}
+
+	record_command(command, monotonic_ns() - start, err);
+	return err;
+}
+
+/**
+ * @brief Counts a failed command in the runtime statistics.
+ *
+ * @param err_code
+ * @return err_code
+ */
+int count_error(int err_code) {
+	int i = error_index(err_code);
+	if (i >= 0) STATS_ADD(run_stats.errors[i], 1);
+	return err_code;
+}
+
+/**
+ * @brief Adds the statistics counted by the current thread to the runtime statistics.
+ */
+void stats_flush(void) {
+	STATS_ADD(run_stats.comparisons, local_stats.comparisons);
+	STATS_ADD(run_stats.placements, local_stats.placements);
+	STATS_ADD(run_stats.placement_nodes, local_stats.placement_nodes);
+	local_stats.comparisons = 0;
+	local_stats.placements = 0;
+	local_stats.placement_nodes = 0;
+}
+
+/**
+ * @brief Records one run of a command in the runtime statistics, along with the
+ * comparisons and placements it made, see stats_flush().
+ *
+ * @param command command character
+ * @param elapsed_ns time the command took
+ * @param err return value of the command, counted as an error if negative
+ */
+void record_command(char command, long long elapsed_ns, int err) {
+	stats_flush();
+	if (command < 'A' || command > 'Z') return;
+	CommandStats *cmnd_stats = &run_stats.commands[command - 'A'];
+
+	// Bucket: number of bits in the latency
+	int bucket = 0;
+	for (unsigned long long ns = (elapsed_ns > 0) ? elapsed_ns : 0; ns != 0; ns >>= 1) bucket++;
+	if (bucket >= STATS_BUCKETS) bucket = STATS_BUCKETS - 1;
+
+	STATS_ADD(cmnd_stats -> count, 1);
+	STATS_ADD(cmnd_stats -> total_ns, elapsed_ns);
+	STATS_ADD(cmnd_stats -> hist[bucket], 1);
+	if (err < 0) {
+		STATS_ADD(cmnd_stats -> errors, 1);
+		count_error(err);
+	}
+}
+
+/**
+ * @brief Prints the runtime statistics into a stream, one "<name> <value>" line per value.
+ * Commands and error codes that never occurred are left out. A histogram is printed as
+ * "<bucket>:<count>" pairs of its non-empty buckets, see CommandStats.
+ *
+ * STATS: students <n>
+ *        comparisons <n>
+ *        placements <n>
+ *        placement_nodes <n>
+ *        record_bytes <n>
+ *        cmd.<command>.count <n>
+ *        cmd.<command>.errors <n>
+ *        cmd.<command>.total_ns <n>
+ *        cmd.<command>.hist <bucket>:<count> ...
+ *        error.<error code head> <n>
+ *
+ * @param stream
+ * @param heads pointers to the heads of the linked lists that make up the list
+ * @param lists number of lists
+ */
+void print_stats(FILE *stream, Student **heads, int lists) {
+	unsigned long students = 0;
+	for (int i = 0; i < lists; i++) students += list_of(heads[i]) -> id_index.count;
+
+	stats_flush();
+	fprintf(stream, "students %lu\n", students);
+	fprintf(stream, "comparisons %lld\n", STATS_GET(run_stats.comparisons));
+	fprintf(stream, "placements %lld\n", STATS_GET(run_stats.placements));
+	fprintf(stream, "placement_nodes %lld\n", STATS_GET(run_stats.placement_nodes));
+	fprintf(stream, "record_bytes %lld\n", STATS_GET(run_stats.record_bytes));
+
+	for (int i = 0; i < STATS_COMMANDS; i++) {
+		CommandStats *cmnd_stats = &run_stats.commands[i];
+		long long count = STATS_GET(cmnd_stats -> count);
+		if (count == 0) continue;
+
+		char command = (char)('A' + i);
+		fprintf(stream, "cmd.%c.count %lld\n", command, count);
+		fprintf(stream, "cmd.%c.errors %lld\n", command, STATS_GET(cmnd_stats -> errors));
+		fprintf(stream, "cmd.%c.total_ns %lld\n", command, STATS_GET(cmnd_stats -> total_ns));
+		fprintf(stream, "cmd.%c.hist", command);
+		for (int b = 0; b < STATS_BUCKETS; b++) {
+			long long hits = STATS_GET(cmnd_stats -> hist[b]);
+			if (hits) fprintf(stream, " %d:%lld", b, hits);
+		}
+		fputc('\n', stream);
+	}
+
+	for (int i = 0; i < NUM_ERRORS; i++) {
+		long long errors = STATS_GET(run_stats.errors[i]);
+		if (errors) fprintf(stream, "error.%s %lld\n", err_codes[i].head, errors);
+	}
+}
+
+/**
+ * @brief Finds the given error code from err_codes[].
+ *
+ * @param err_code
+ * @return index of the error code in err_codes[], -1 if not found
+ */
+int error_index(int err_code) {
+	for (int i = 0; i < NUM_ERRORS; i++) {
+		if (err_codes[i].code == err_code) return i;
+	}
+	return -1;
+}
+
+/**
+ * @brief Prints information to stdout about the given error code.
+ *
+ * @param err_code
+ */
+void print_error(int err_code) {
+	print_error_to(stdout, err_code);
+}
+
+/**
+ * @brief Prints information about the given error code into a stream, like print_error().
+ *
+ * @param stream
+ * @param err_code
+ *
+ * @note Error messages are defined in err_codes[]
+ */
+void print_error_to(FILE *stream, int err_code) {
+	// Holds the head and error message
+	const char *head = NULL;
+	const char *msg = NULL;
+
+	// Search for the matching code
+	int i = error_index(err_code);
+	if (i >= 0) {
+		head = err_codes[i].head;
+		msg = err_codes[i].msg;
+	}
+
+	// Print error
+	fprintf(stream, "ERROR (%d) %s: %s\n", err_code, head, msg);
+}
+
+/**
+ * @brief Initializes a LineReader with an empty block buffer of BATCH_READ_SIZE.
+ *
+ * @attention Use line_reader_free() to free the buffer.
+ *
+ * @param reader
+ * @param stream stream to read lines from
+ * @return 0 if successful, error code otherwise
+ */
+int line_reader_init(LineReader *reader, FILE *stream) {
+	reader -> buf = malloc(BATCH_READ_SIZE + 1);    // +1 for '\0' after the last line
+	if (reader -> buf == NULL) return ERR_MEM_ALLOC_FAIL;   // Handle alloc failure
+
+	reader -> stream = stream;
+	reader -> capacity = BATCH_READ_SIZE;
+	reader -> start = 0;
+	reader -> end = 0;
+	reader -> saved = '\0';
+	reader -> saved_pos = 0;
+	return 0;
+}
+
+/**
+ * @brief Returns the next line from the stream, including its newline if it has one, as a
+ * modifiable '\0'-terminated string inside the block buffer. The string is valid until
+ * the next call. Lines can be of any length.
+ *
+ * @param reader
+ * @return pointer to the line, NULL on EOF (or if a long line could not fit in memory)
+ */
+char *read_line(LineReader *reader) {
+	// Put back the character that the previous line's '\0' replaced
+	reader -> buf[reader -> saved_pos] = reader -> saved;
+
+	char *newline;
+	while ((newline = memchr(reader -> buf + reader -> start, '\n',
+		reader -> end - reader -> start)) == NULL) {
+		// Move the partial line to the front to make room for the next block
+		size_t partial = reader -> end - reader -> start;
+		memmove(reader -> buf, reader -> buf + reader -> start, partial);
+		reader -> start = 0;
+		reader -> end = partial;
+
+		// Grow if the partial line fills the whole buffer
+		if (reader -> end == reader -> capacity) {
+			char *new_buf = realloc(reader -> buf, reader -> capacity * 2 + 1);
+			if (new_buf == NULL) return NULL;   // Handle alloc failure
+			reader -> buf = new_buf;
+			reader -> capacity *= 2;
+		}
+
+		size_t got = fread(reader -> buf + reader -> end, 1,
+			reader -> capacity - reader -> end, reader -> stream);
+		reader -> end += got;
+
+		if (got == 0) {     // EOF: hand out the last line without newline, if any
+			if (reader -> start == reader -> end) return NULL;
+			newline = reader -> buf + reader -> end - 1;
+			break;
+		}
+	}
+
+	// Terminate the line after its newline, remembering the overwritten character
+	char *line = reader -> buf + reader -> start;
+	reader -> start = newline - reader -> buf + 1;
+	reader -> saved_pos = reader -> start;
+	reader -> saved = reader -> buf[reader -> start];
+	reader -> buf[reader -> start] = '\0';
+
+	return line;
+}
+
+/**
+ * @brief Frees the block buffer of a LineReader.
+ *
+ * @param reader
+ */
+void line_reader_free(LineReader *reader) {
+	free(reader -> buf);
+	reader -> buf = NULL;
+}
+
+/**
+ * @brief Checks if stdin is an interactive terminal.
+ *
+ * @return TRUE if stdin is a terminal, FALSE if it is e.g. a pipe or a file
+ */
+int stdin_is_tty(void) {
+	#ifndef _WIN32
+	return isatty(fileno(stdin)) ? TRUE : FALSE;
+	#else
+	return _isatty(_fileno(stdin)) ? TRUE : FALSE;
+	#endif
+}
+
+/**
+ * @brief Runs commands typed by the user line by line until QUIT or EOF.
+ *
+ * @param students_head pointer to the head of the linked list
+ * @return exit status of the program
+ */
+int run_interactive(Student *students_head) {
+	char input[INPUT_BUFFER_SIZE];      // Input buffer
+	int ret = 0;                        // Holds return value from run()
+
+	Journal *journal = list_of(students_head) -> journal;
+
+	// Main program loop, stops on QUIT or EOF
+	while (ret != QUIT_FLAG) {
+		// Sync the journal while waiting for the user
+		int err = journal_sync(journal);
+		if (err) print_error(err);
+
+		if (fgets(input, sizeof(input), stdin) == NULL) break;
+		ret = run(input, students_head);    // Attempt to run user input
+
+		// Prints possible error message
+		if (ret < 0) print_error(ret);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Runs a script of commands from stdin until QUIT or EOF. Input is read in blocks of
+ * BATCH_READ_SIZE and output is collected in a buffer of BATCH_WRITE_SIZE, which is also
+ * flushed after every LIST. A summary of failed commands is printed to stderr at the end.
+ *
+ * @param students_head pointer to the head of the linked list
+ * @return EXIT_SUCCESS if every command succeeded, EXIT_FAILURE otherwise
+ */
+int run_batch(Student *students_head) {
+	static char output_buffer[BATCH_WRITE_SIZE];
+	setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+
+	LineReader reader;
+	if (line_reader_init(&reader, stdin)) {     // Handle alloc failure
+		print_error(ERR_MEM_ALLOC_FAIL);
+		return EXIT_FAILURE;
+	}
+
+	long commands = 0;                  // Number of commands run
+	long failed = 0;                    // Number of commands that ended in an error
+	long failed_by_code[NUM_ERRORS + 1] = {0};  // Last element for unknown codes
+	int ret = 0;                        // Holds return value from run()
+	char *input;
+
+	// Main program loop, stops on QUIT or EOF
+	while (ret != QUIT_FLAG && (input = read_line(&reader)) != NULL) {
+		char command = input[0];
+		ret = run(input, students_head);    // Attempt to run the command
+		commands++;
+
+		// Prints possible error message
+		if (ret < 0) {
+			print_error(ret);
+			failed++;
+			int i = error_index(ret);
+			failed_by_code[(i >= 0) ? i : NUM_ERRORS]++;
+		}
+		else if (command == LIST) fflush(stdout);
+
+		// Close the journal's group commit window if it has passed
+		int err = journal_tick(list_of(students_head) -> journal);
+		if (err) print_error(err);
+	}
+
+	line_reader_free(&reader);
+	fflush(stdout);
+
+	// Summary of failed commands
+	fprintf(stderr, "Batch: %ld commands, %ld failed\n", commands, failed);
+	for (int i = 0; i < NUM_ERRORS; i++) {
+		if (failed_by_code[i]) fprintf(stderr, "  %s: %ld\n", err_codes[i].head, failed_by_code[i]);
+	}
+	if (failed_by_code[NUM_ERRORS]) {
+		fprintf(stderr, "  ERR_UNKNOWN: %ld\n", failed_by_code[NUM_ERRORS]);
+	}
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#ifdef __linux__
+// Set by server_stop_signal() when the server should shut down
+volatile sig_atomic_t server_stop_requested = 0;
+
+/**
+ * @brief Tells if a command only reads the list, so that server clients can run it in
+ * parallel with other such commands.
+ *
+ * @param command command character
+ * @return TRUE if the command never changes the list, FALSE otherwise
+ */
+int is_query(char command) {
+	switch (command) {
+		case LIST:
+		case WRITE:
+		case QUIT:
+		case STATS:
+		case TOP:
+		case RANK:
+		case RANGE:
+		case NAME:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/**
+ * @brief Tells if a query can run without changing the list: in lazy ordering mode a query
+ * may have to sort the list first, and NAME may have to rebuild the name index.
+ *
+ * @param students_head pointer to the head of the linked list
+ * @param command command character of a query, see is_query()
+ * @return TRUE if the query only reads the list, FALSE otherwise
+ */
+int query_ready(Student *students_head, char command) {
+	ListHead *list = list_of(students_head);
+	if (list -> dirty) return FALSE;
+	if (command == NAME && list -> names_stale) return FALSE;
+	return TRUE;
+}
+
+/**
+ * @brief Sets up a server: creates a Unix domain socket listening in the given path and an
+ * event loop watching it. A file left in the path by an earlier server is replaced. With
+ * several shards, the list is copied into the shards and the server owns the copies;
+ * otherwise the server's only shard is the given list.
+ *
+ * @attention Use server_close() to release the server.
+ *
+ * @param server
+ * @param students_head pointer to the head of the linked list
+ * @param path file name of the socket
+ * @param shard_count number of shards, 1 to MAX_SHARDS
+ * @return 0 if successful, error code otherwise
+ */
+int server_open(Server *server, Student *students_head, const char *path, int shard_count) {
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path)) return ERR_FILENAME_LEN;   // Handle error
+
+	memset(server, 0, sizeof(*server));
+	server -> shard_count = shard_count;
+	server -> path = path;
+	server -> epoll_fd = -1;
+
+	server -> listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (server -> listen_fd < 0) return ERR_SERVER_SOCKET;  // Handle error
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;  // The listening socket is the only one without a Client
+	if (bind(server -> listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+		|| listen(server -> listen_fd, SERVER_BACKLOG) < 0
+		|| fcntl(server -> listen_fd, F_SETFL, O_NONBLOCK) < 0
+		|| (server -> epoll_fd = epoll_create1(0)) < 0
+		|| epoll_ctl(server -> epoll_fd, EPOLL_CTL_ADD, server -> listen_fd, &event) < 0) {
+		// Handle error
+		if (server -> epoll_fd >= 0) close(server -> epoll_fd);
+		close(server -> listen_fd);
+		unlink(path);
+		return ERR_SERVER_SOCKET;
+	}
+
+	// Split the list into the shards
+	Student *heads[MAX_SHARDS] = {students_head};
+	int err = 0;
+	if (shard_count > 1) {
+		err = ensure_sorted(students_head);
+		if (!err) err = split_linked_list(students_head, heads, shard_count);
+	}
+	if (err) {  // Handle error
+		close(server -> epoll_fd);
+		close(server -> listen_fd);
+		unlink(path);
+		return err;
+	}
+	for (int i = 0; i < shard_count; i++) {
+		server -> shards[i].students_head = heads[i];
+		pthread_rwlock_init(&server -> shards[i].lock, NULL);
+		pthread_mutex_init(&server -> shards[i].snapshot_lock, NULL);
+	}
+
+	pthread_mutex_init(&server -> queue_lock, NULL);
+	pthread_cond_init(&server -> queue_cond, NULL);
+	return 0;
+}
+
+/**
+ * @brief Releases a server: disconnects the remaining clients, removes the socket and frees
+ * the shards the server owns.
+ *
+ * @attention The worker threads must have exited.
+ *
+ * @param server
+ */
+void server_close(Server *server) {
+	while (server -> clients != NULL) client_close(server, server -> clients);
+
+	close(server -> epoll_fd);
+	close(server -> listen_fd);
+	unlink(server -> path);
+
+	for (int i = 0; i < server -> shard_count; i++) {
+		Shard *shard = &server -> shards[i];
+		if (shard -> snapshot != NULL) snapshot_release(shard, shard -> snapshot);
+		if (server -> shard_count > 1) free_linked_list(shard -> students_head);
+		pthread_rwlock_destroy(&shard -> lock);
+		pthread_mutex_destroy(&shard -> snapshot_lock);
+	}
+	pthread_mutex_destroy(&server -> queue_lock);
+	pthread_cond_destroy(&server -> queue_cond);
+}
+
+/**
+ * @brief Adds a client to the end of the ready queue and wakes up a worker.
+ *
+ * @param server
+ * @param client
+ */
+void server_enqueue(Server *server, Client *client) {
+	pthread_mutex_lock(&server -> queue_lock);
+	client -> next_ready = NULL;
+	if (server -> ready_tail == NULL) server -> ready_head = client;
+	else server -> ready_tail -> next_ready = client;
+	server -> ready_tail = client;
+	pthread_cond_signal(&server -> queue_cond);
+	pthread_mutex_unlock(&server -> queue_lock);
+}
+
+/**
+ * @brief Takes the first client from the ready queue, waiting until there is one.
+ *
+ * @param server
+ * @return the client, NULL if the server is stopping
+ */
+Client *server_dequeue(Server *server) {
+	pthread_mutex_lock(&server -> queue_lock);
+	while (server -> ready_head == NULL && !server -> stopping) {
+		pthread_cond_wait(&server -> queue_cond, &server -> queue_lock);
+	}
+
+	Client *client = NULL;
+	if (!server -> stopping) {
+		client = server -> ready_head;
+		server -> ready_head = client -> next_ready;
+		if (server -> ready_head == NULL) server -> ready_tail = NULL;
+	}
+	pthread_mutex_unlock(&server -> queue_lock);
+	return client;
+}
+
+/**
+ * @brief Accepts every pending connection and registers the new clients to the event loop.
+ *
+ * @param server
+ * @return 0 if successful, error code otherwise
+ */
+int server_accept(Server *server) {
+	int fd;
+	while ((fd = accept(server -> listen_fd, NULL, NULL)) >= 0) {
+		Client *client = calloc(1, sizeof(Client));
+		if (client != NULL) client -> in = malloc(SERVER_READ_SIZE + 1);
+		if (client == NULL || client -> in == NULL) {   // Handle alloc failure
+			if (client != NULL) free(client);
+			close(fd);
+			return ERR_MEM_ALLOC_FAIL;
+		}
+		client -> fd = fd;
+		client -> capacity = SERVER_READ_SIZE;
+
+		pthread_mutex_lock(&server -> queue_lock);
+		client -> next = server -> clients;
+		if (server -> clients != NULL) server -> clients -> prev = client;
+		server -> clients = client;
+		pthread_mutex_unlock(&server -> queue_lock);
+
+		struct epoll_event event;
+		event.events = EPOLLIN | EPOLLONESHOT;
+		event.data.ptr = client;
+		if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0
+			|| epoll_ctl(server -> epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+			client_close(server, client);   // Handle error
+		}
+	}
 
-	FILE *file = fopen(filename, "w");
-	if (file == NULL) return ERR_FILE_OPEN;     // Handle error
+	return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : ERR_SERVER_SOCKET;
+}
 
-	// Go through linked list, printing each Student to file
-	while (curr_student != NULL) {
-		int err = print_to_stream(file, curr_student);
-		if (err) {  // Handle error
-			fclose(file);
-			return err;
+/**
+ * @brief Disconnects a client and frees it.
+ *
+ * @param server
+ * @param client
+ */
+void client_close(Server *server, Client *client) {
+	pthread_mutex_lock(&server -> queue_lock);
+	if (client -> prev != NULL) client -> prev -> next = client -> next;
+	else server -> clients = client -> next;
+	if (client -> next != NULL) client -> next -> prev = client -> prev;
+	pthread_mutex_unlock(&server -> queue_lock);
+
+	close(client -> fd);    // Also removes the socket from the event loop
+	free(client -> in);
+	free(client -> out);
+	free(client);
+}
+
+/**
+ * @brief Reads everything the client has sent so far into its input buffer.
+ *
+ * @param client
+ * @return TRUE if the connection is still open, FALSE if the client has hung up
+ */
+int client_receive(Client *client) {
+	for (;;) {
+		// Grow if the buffer is full
+		if (client -> len == client -> capacity) {
+			char *new_in = realloc(client -> in, client -> capacity * 2 + 1);
+			if (new_in == NULL) return FALSE;   // Handle alloc failure
+			client -> in = new_in;
+			client -> capacity *= 2;
 		}
 
-		curr_student = curr_student -> next;
+		ssize_t got = read(client -> fd, client -> in + client -> len,
+			client -> capacity - client -> len);
+		if (got > 0) client -> len += got;
+		else if (got == 0) return FALSE;
+		else if (errno == EAGAIN || errno == EWOULDBLOCK) return TRUE;
+		else if (errno != EINTR) return FALSE;
 	}
+}
 
-	fclose(file);
-	return 0;
+/**
+ * @brief Sends as much of a client's pending output as the socket takes without waiting.
+ * The output is freed once all of it has been sent.
+ *
+ * @param client
+ * @return TRUE if successful, FALSE if the connection failed
+ */
+int client_flush(Client *client) {
+	while (client -> out_sent < client -> out_len) {
+		ssize_t sent = send(client -> fd, client -> out + client -> out_sent,
+			client -> out_len - client -> out_sent, MSG_NOSIGNAL);
+		if (sent >= 0) client -> out_sent += sent;
+		else if (errno == EAGAIN || errno == EWOULDBLOCK) return TRUE;  // Wait for EPOLLOUT
+		else if (errno != EINTR) return FALSE;
+	}
+
+	free(client -> out);
+	client -> out = NULL;
+	client -> out_len = 0;
+	client -> out_sent = 0;
+	return TRUE;
 }
 
 /**
- * @brief Loads file contents into memory. Rewrites the old linked list if file could be
- * read successfully. Leaves the old linked list intact if loading fails. Assumes valid
- * input.
+ * @brief Runs every complete command line a client has sent, collecting their output as
+ * the client's pending output. A partial last line is kept for the next time, unless the
+ * client has hung up. Stops at QUIT.
  *
- * @param filename
- * @param students_head
- * @return 0 if successful, error code otherwise
+ * @param server
+ * @param client
+ * @param hung_up TRUE if the client has hung up
+ * @return TRUE if successful, FALSE if the output could not be collected
  */
-int load_file(char *filename, Student *students_head) {
-	FILE *file = fopen(filename, "r");
-	if (file == NULL) return ERR_FILE_OPEN;     // Handle error
+int client_run_input(Server *server, Client *client, int hung_up) {
+	FILE *stream = open_memstream(&client -> out, &client -> out_len);
+	if (stream == NULL) return FALSE;   // Handle alloc failure
+
+	size_t start = 0;
+	int ret = 0;
+	while (ret != QUIT_FLAG && start < client -> len) {
+		char *newline = memchr(client -> in + start, '\n', client -> len - start);
+		if (newline == NULL) {
+			if (!hung_up) break;    // Wait for the rest of the line
+			newline = client -> in + client -> len - 1;     // Hung up: run the last line
+		}
 
-	int err = 0;    // Holds error codes which will terminate load operation
+		// Terminate the line after its newline, like read_line()
+		size_t end = newline - client -> in + 1;
+		char saved = client -> in[end];
+		client -> in[end] = '\0';
+		ret = server_run_line(server, client -> in + start, stream);
+		client -> in[end] = saved;
+		start = end;
+	}
 
-	Student *old_list = students_head -> next;  // Holds the previous linked list
-	students_head -> next = NULL;               // Un-link the head node
+	// Keep the partial last line
+	memmove(client -> in, client -> in + start, client -> len - start);
+	client -> len -= start;
+	if (ret == QUIT_FLAG) client -> closing = TRUE;
 
-	char buffer[INPUT_BUFFER_SIZE];
+	fclose(stream);
+	if (client -> out_len == 0) {
+		free(client -> out);
+		client -> out = NULL;
+	}
+	return TRUE;
+}
 
-	// Keep reading lines from file until EOF or error flag gets set
-	while ((fgets(buffer, sizeof(buffer), file) != NULL) && !err) {
-		// Parse the line
-		Input *parsed_inp = parse_input(buffer, &err, FALSE);
-		if (parsed_inp == NULL) {   // Handle error
-			break;
-		}
+/**
+ * @brief Locks every shard of a server, in order.
+ *
+ * @param server
+ * @param exclusive TRUE to lock the shards exclusively, FALSE to lock them shared
+ */
+void server_lock_all(Server *server, int exclusive) {
+	for (int i = 0; i < server -> shard_count; i++) {
+		if (exclusive) pthread_rwlock_wrlock(&server -> shards[i].lock);
+		else pthread_rwlock_rdlock(&server -> shards[i].lock);
+	}
+}
 
-		// Validate the read line
-		err = validate_input(parsed_inp);
-		if (err) {  // Handle error
-			free_parsed_input(parsed_inp);
-			break;
+/**
+ * @brief Unlocks every shard of a server.
+ *
+ * @param server
+ */
+void server_unlock_all(Server *server) {
+	for (int i = 0; i < server -> shard_count; i++) {
+		pthread_rwlock_unlock(&server -> shards[i].lock);
+	}
+}
+
+/**
+ * @brief Runs one command line of a client on one shard under the shard's lock and prints
+ * its output, including a possible error message, into a stream. Queries hold the lock
+ * shared, unless they would have to sort the list or rebuild an index first.
+ *
+ * @param shard
+ * @param line modifiable command line
+ * @param stream stream for the output of the command
+ * @return return value of run_command()
+ */
+int server_run_locked(Shard *shard, char *line, FILE *stream) {
+	Student *students_head = shard -> students_head;
+	char command = line[0];
+
+	int shared = is_query(command);
+	if (shared) {
+		pthread_rwlock_rdlock(&shard -> lock);
+		if (!query_ready(students_head, command)) {
+			pthread_rwlock_unlock(&shard -> lock);
+			shared = FALSE;
 		}
+	}
+	if (!shared) pthread_rwlock_wrlock(&shard -> lock);
 
-		char **arg_arr = parsed_inp -> arg_arr;     // Just as a shorthand
+	int ret = shard_run(shard, line, stream, !shared);
+	pthread_rwlock_unlock(&shard -> lock);
+	return ret;
+}
 
-		// Add student into list
-		err = add_student(arg_arr[0], arg_arr[1], arg_arr[2], students_head);
-		if (err) {  // Handle error
-			if (err == ERR_STDNT_IN_LIST) err = ERR_FILE_CORR;  // Change of error code
-			free_parsed_input(parsed_inp);
-			break;
-		}
+/**
+ * @brief Runs one command line of a client on a shard that the caller has locked and
+ * prints its output, including a possible error message, into a stream.
+ *
+ * @param shard
+ * @param line modifiable command line
+ * @param stream stream for the output of the command
+ * @param exclusive TRUE if the shard is locked exclusively
+ * @return return value of run_command()
+ */
+int shard_run(Shard *shard, char *line, FILE *stream, int exclusive) {
+	Student *students_head = shard -> students_head;
 
-		// Read student points
-		for (int i = 0; i < EXCRS_RNDS; i++) {
-			// Convert integer to string in preparation for update_points()
-			char i_str[12];
-			sprintf(i_str, "%d", i + 1);    // i + 1: "points[0]" means "1st round points"
+	int ret = run_command(line, students_head, stream);
+	if (ret < 0) print_error_to(stream, ret);
 
-			err = update_points(arg_arr[0], i_str, arg_arr[3 + i], students_head);
-			if (err) break;     // Handle error. Breaks out of for-loop, not while-loop
+	// Close the journal's group commit window if it has passed
+	if (exclusive) {
+		int err = journal_tick(list_of(students_head) -> journal);
+		if (err) print_error_to(stream, err);
+	}
+	if (!is_query(line[0])) shard -> version++;     // The shard may have changed
+
+	return ret;
+}
+
+/**
+ * @brief Runs an UPDATE line of a client on a sharded list. The Student can't be in an
+ * empty shard, so there the command must fail like on an unsharded list: with
+ * ERR_STDNT_NOT_FND unless the whole list is empty. It then runs on a non-empty shard
+ * instead, or on its own if every shard is empty, where it fails before changing
+ * anything. So the shards are only locked shared and no version, and thus no snapshot,
+ * changes.
+ *
+ * @param server
+ * @param line modifiable command line
+ * @param stream stream for the output of the command
+ * @return return value of run_command()
+ */
+int server_run_update(Server *server, char *line, FILE *stream) {
+	Shard *shard = shard_of_line(server, line);
+
+	for (;;) {
+		pthread_rwlock_wrlock(&shard -> lock);
+		if (shard -> students_head -> next != NULL) {
+			int ret = shard_run(shard, line, stream, TRUE);
+			pthread_rwlock_unlock(&shard -> lock);
+			return ret;
+		}
+		pthread_rwlock_unlock(&shard -> lock);
+
+		server_lock_all(server, FALSE);
+		if (shard -> students_head -> next == NULL) {
+			Shard *target = shard;
+			for (int i = 0; i < server -> shard_count
+				&& target -> students_head -> next == NULL; i++) {
+				target = &server -> shards[i];
+			}
+
+			int ret = run_command(line, target -> students_head, stream);
+			if (ret < 0) print_error_to(stream, ret);
+			server_unlock_all(server);
+			return ret;
 		}
+		server_unlock_all(server);  // The shard got its first Student meanwhile: retry
+	}
+}
+
+/**
+ * @brief Runs a query other than LIST or WRITE of a client on a sharded list and prints
+ * its output, including a possible error message, into a stream. The shards are locked
+ * shared and the query merges its answer from all of them, see run_command_on(), unless a
+ * shard would have to be sorted or indexed first: then they are locked exclusively.
+ *
+ * @param server
+ * @param line modifiable command line
+ * @param stream stream for the output of the command
+ * @return return value of run_command_on()
+ */
+int server_run_query(Server *server, char *line, FILE *stream) {
+	int count = server -> shard_count;
 
-		free_parsed_input(parsed_inp);
+	server_lock_all(server, FALSE);
+	int ready = TRUE;
+	for (int i = 0; i < count; i++) {
+		if (!query_ready(server -> shards[i].students_head, line[0])) ready = FALSE;
+	}
+	if (!ready) {
+		server_unlock_all(server);
+		server_lock_all(server, TRUE);
 	}
 
-	fclose(file);
+	Student *heads[MAX_SHARDS];
+	for (int i = 0; i < count; i++) heads[i] = server -> shards[i].students_head;
 
-	// Start terminating procedure if error flag was set previously
-	if (err) {
-		free_linked_list(students_head -> next);    // Free the failed list
-		students_head -> next = old_list;   // Re-link the old list to revert back
-		return err;
+	int ret = run_command_on(line, heads, count, stream);
+	if (ret < 0) print_error_to(stream, ret);
+
+	server_unlock_all(server);
+	return ret;
+}
+
+/**
+ * @brief Runs a LIST or WRITE line of a client on a Snapshot and prints its output,
+ * including a possible error message, into a stream. No shard is locked while the command
+ * runs.
+ *
+ * @param server
+ * @param line modifiable command line
+ * @param stream stream for the output of the command
+ * @return return value of run_command_on()
+ */
+int server_run_snapshot(Server *server, char *line, FILE *stream) {
+	int count = server -> shard_count;
+	Snapshot *snapshots[MAX_SHARDS];
+	Student *heads[MAX_SHARDS];
+
+	int err = snapshot_acquire(server, snapshots);
+	for (int i = 0; i < count && !err; i++) heads[i] = snapshots[i] -> students_head;
+
+	int ret = err ? err : run_command_on(line, heads, count, stream);
+	if (ret < 0) print_error_to(stream, ret);
+
+	for (int i = 0; i < count && !err; i++) {
+		snapshot_release(&server -> shards[i], snapshots[i]);
 	}
+	return ret;
+}
 
-	free_linked_list(old_list);
-	return 0;
+/**
+ * @brief Finds the shards that the changes of a batch update file belong to, from the
+ * student ID of each line. Lines without a valid ID are skipped: they make the batch fail
+ * before anything changes anyway.
+ *
+ * @param server
+ * @param line BATCH command line
+ * @param affected set to TRUE for each shard that a change belongs to, FALSE for the rest
+ */
+void batch_shards(Server *server, const char *line, int *affected) {
+	for (int i = 0; i < server -> shard_count; i++) affected[i] = FALSE;
+
+	// Split like parse_input() does; a bad name fails the command anyway
+	Span tokens[2];
+	char filename[FILENAME_MAX];
+	if (split_span(line, strcspn(line, "\n"), tokens, 2) < 2
+		|| tokens[1].len >= sizeof(filename)) return;
+	memcpy(filename, tokens[1].start, tokens[1].len);
+	filename[tokens[1].len] = '\0';
+
+	FileView view;
+	if (open_file_view(filename, &view)) return;
+	const char *pos = view.data;
+	const char *end = view.data + view.size;
+	while (pos < end) {
+		const char *eol = memchr(pos, '\n', end - pos);
+		size_t len = (eol != NULL) ? (size_t)(eol - pos) : (size_t)(end - pos);
+
+		Span fields[1];
+		if (split_span(pos, len, fields, 1) >= 1
+			&& !validate_id_span(fields[0].start, fields[0].len)) {
+			char student_id[STDNT_ID_LEN + 1];
+			memcpy(student_id, fields[0].start, fields[0].len);
+			student_id[fields[0].len] = '\0';
+			affected[shard_of(student_id, server -> shard_count)] = TRUE;
+		}
+		pos += len + 1;
+	}
+	close_file_view(&view);
 }
 
 /**
- * @brief Attempt to run the user given command.
+ * @brief Runs a BATCH line of a client on a sharded list and prints its output, including
+ * a possible error message, into a stream. Only the shards that the file's changes belong
+ * to are locked, exclusively and in order, and each change is applied in its own shard,
+ * see batch_update(). A change to another shard, if the file changed in the meantime,
+ * fails the batch with ERR_FILE_CORR before anything changes.
  *
- * @param input modifiable user input string
- * @param students_head pointer to the head of the linked list
- * @return 0 if successful, 1 if QUIT command given, error code if unsuccessful
+ * @param server
+ * @param line modifiable command line
+ * @param stream stream for the output of the command
+ * @return return value of run_command_on()
  */
-int run(char *input, Student *students_head) {
-	int err = 0;    // Holds return values
+int server_run_batch(Server *server, char *line, FILE *stream) {
+	int count = server -> shard_count;
+	int affected[MAX_SHARDS];
+	batch_shards(server, line, affected);
+
+	Student *heads[MAX_SHARDS];
+	for (int i = 0; i < count; i++) {
+		heads[i] = NULL;
+		if (!affected[i]) continue;
+		pthread_rwlock_wrlock(&server -> shards[i].lock);
+		heads[i] = server -> shards[i].students_head;
+	}
 
-	// Parse the user's input
-	Input *parsed_inp = parse_input(input, &err, TRUE);
+	int ret = run_command_on(line, heads, count, stream);
+	if (ret < 0) print_error_to(stream, ret);
 
-	/* =====================================================================================
-	Handles a special case to meet project requirements. This combination of err and non
-	NULL return value is only used to print: "Invalid command <command char>\n" into
-	stdout. Otherwise unnecessary and only serves to make code less readable.*/
-	if (err && parsed_inp != NULL) {
-		printf("Invalid command %c\n", parsed_inp -> cmnd);
-		free(parsed_inp);
-		return 0; // 0 return fools normal error detection to prevent another error printout
+	for (int i = 0; i < count; i++) {
+		if (!affected[i]) continue;
+		if (ret == 0) server -> shards[i].version++;
+		pthread_rwlock_unlock(&server -> shards[i].lock);
 	}
-	// =====================================================================================
+	return ret;
+}
 
-	// Back to normal error handling
-	if (parsed_inp == NULL) {
-		if (err) return err;        // Handles known errors
-		else return ERR_UNKNOWN;    // Handles unknown errors (should never happen)
+/**
+ * @brief Runs a LOAD line of a client on a whole sharded list and prints its output,
+ * including a possible error message, into a stream. Every shard is locked while the
+ * command runs on a new empty list. If the command succeeds, the list is split into new
+ * shards that replace the old ones; otherwise the shards are left as they were.
+ *
+ * @param server
+ * @param line modifiable command line
+ * @param stream stream for the output of the command
+ * @return return value of run_command()
+ */
+int server_run_resharded(Server *server, char *line, FILE *stream) {
+	int count = server -> shard_count;
+	Student *heads[MAX_SHARDS];
+	Student *new_heads[MAX_SHARDS];
+	int err = 0;
+
+	server_lock_all(server, TRUE);
+	for (int i = 0; i < count; i++) heads[i] = server -> shards[i].students_head;
+
+	Student *students_head = init_linked_list();
+	if (students_head == NULL) err = ERR_MEM_ALLOC_FAIL;    // Handle alloc failure
+	else {
+		set_lazy_ordering(students_head, list_of(heads[0]) -> lazy);
+		list_of(students_head) -> workers = list_of(heads[0]) -> workers;
 	}
 
-	// Validate the user's input
-	err = validate_input(parsed_inp);
-	if (err) {  // Return error code
-		free_parsed_input(parsed_inp);
-		return err;
+	int ret = err ? err : run_command(line, students_head, stream);
+	if (ret < 0) print_error_to(stream, ret);
+
+	// Replace the shards
+	if (ret == 0) {
+		err = ensure_sorted(students_head);
+		if (!err) err = split_linked_list(students_head, new_heads, count);
+		if (err) {  // Handle error
+			print_error_to(stream, err);
+			ret = err;
+		}
+		else {
+			for (int i = 0; i < count; i++) {
+				free_linked_list(heads[i]);
+				server -> shards[i].students_head = new_heads[i];
+				server -> shards[i].version++;
+			}
+		}
 	}
 
-	// Both of these are just for shorthand
-	char command = parsed_inp -> cmnd;
-	char **arg_arr = parsed_inp -> arg_arr;
+	free_linked_list(students_head);
+	server_unlock_all(server);
+	return ret;
+}
 
-	switch(command) {
-		case ADD:       // ADD: <'A'> <student ID> <last name> <first name>
-			err = add_student(arg_arr[1], arg_arr[2], arg_arr[3], students_head);
-			if (!err) puts("SUCCESS");
-			break;
+/**
+ * @brief Finds the shard of the Student that a command line is about, from the student ID
+ * in its second argument. Lines without a proper ID go to the first shard, which is as
+ * good as any for reporting the error.
+ *
+ * @param server
+ * @param line command line
+ * @return the shard
+ */
+Shard *shard_of_line(Server *server, const char *line) {
+	if (server -> shard_count == 1) return &server -> shards[0];
+
+	// Split like parse_input() does
+	Span tokens[2];
+	int count = split_span(line, strcspn(line, "\n"), tokens, 2);
+	if (count < 2 || tokens[1].len > STDNT_ID_LEN) return &server -> shards[0];
+
+	char student_id[STDNT_ID_LEN + 1];
+	memcpy(student_id, tokens[1].start, tokens[1].len);
+	student_id[tokens[1].len] = '\0';
+	return &server -> shards[shard_of(student_id, server -> shard_count)];
+}
 
-		case UPDATE:    // UPDATE: <'U'> <student ID> <round> <points>
-			err = update_points(arg_arr[1], arg_arr[2], arg_arr[3], students_head);
-			if (!err) puts("SUCCESS");
-			break;
+/**
+ * @brief Runs one command line of a client with the locking that the command needs, see
+ * Server, and prints its output, including a possible error message, into a stream.
+ *
+ * @param server
+ * @param line modifiable command line
+ * @param stream stream for the output of the command
+ * @return return value of run_command()
+ */
+int server_run_line(Server *server, char *line, FILE *stream) {
+	char command = line[0];
+	int sharded = server -> shard_count > 1;
 
-		case LIST:      // LIST: <'L'>
-			err = print_status(students_head);
-			if (!err) puts("SUCCESS");
-			break;
+	if (command == UPDATE && sharded) return server_run_update(server, line, stream);
+	if (command == ADD || command == UPDATE) {
+		return server_run_locked(shard_of_line(server, line), line, stream);
+	}
+	if (command == LIST || command == WRITE) return server_run_snapshot(server, line, stream);
+	if (sharded && is_query(command)) return server_run_query(server, line, stream);
+	if (sharded && command == LOAD) return server_run_resharded(server, line, stream);
+	if (sharded && command == BATCH) return server_run_batch(server, line, stream);
+	return server_run_locked(&server -> shards[0], line, stream);
+}
 
-		case WRITE:     // WRITE: <'W'> <file name>
-			err = write_to_file(arg_arr[1], students_head);
-			if (!err) puts("SUCCESS");
-			break;
+/**
+ * @brief Takes a reference to the snapshot of a shard's current version. If there is none
+ * yet, the shard is copied into a new snapshot, which the shard keeps for later readers.
+ *
+ * @attention The caller must hold the shard's lock. Use snapshot_release() to release the
+ * snapshot.
+ *
+ * @param shard
+ * @param copy FALSE to only take a snapshot that already exists
+ * @param err set to an error code if the copy failed, left as it was otherwise
+ * @return the snapshot, NULL if there was none to take
+ */
+Snapshot *shard_snapshot(Shard *shard, int copy, int *err) {
+	Snapshot *retired = NULL;   // Previous snapshot, if this was its last reference
+
+	pthread_mutex_lock(&shard -> snapshot_lock);
+	Snapshot *snapshot = shard -> snapshot;
+	if (snapshot != NULL && snapshot -> version != shard -> version) snapshot = NULL;
+	if (snapshot == NULL && copy) {
+		snapshot = malloc(sizeof(Snapshot));
+		if (snapshot != NULL) {
+			snapshot -> students_head = merge_linked_lists(&shard -> students_head, 1);
+		}
+		if (snapshot == NULL || snapshot -> students_head == NULL) {    // Handle alloc failure
+			free(snapshot);
+			snapshot = NULL;
+			*err = ERR_MEM_ALLOC_FAIL;
+		}
+		else {
+			snapshot -> version = shard -> version;
+			snapshot -> readers = 1;
+			if (shard -> snapshot != NULL && --shard -> snapshot -> readers == 0) {
+				retired = shard -> snapshot;
+			}
+			shard -> snapshot = snapshot;
+		}
+	}
+	if (snapshot != NULL) snapshot -> readers++;
+	pthread_mutex_unlock(&shard -> snapshot_lock);
 
-		case LOAD:      // LOAD: <'O'> <file name>
-			err = load_file(arg_arr[1], students_head);
-			if (!err) puts("SUCCESS");
-			break;
+	if (retired != NULL) snapshot_free(retired);
+	return snapshot;
+}
 
-		case QUIT:      // QUIT: <'Q'>
-			err = QUIT_FLAG;
-			puts("SUCCESS");
-			break;
+/**
+ * @brief Takes the snapshot of the shard of a SnapshotJob, copying the shard if needed.
+ *
+ * @param arg pointer to SnapshotJob
+ * @return NULL
+ */
+void *snapshot_job(void *arg) {
+	SnapshotJob *job = arg;
+	job -> snapshot = shard_snapshot(job -> shard, TRUE, &job -> err);
+	return NULL;
+}
 
-		default:        // Should never happen due to other checks
-			err = ERR_UNKNOWN;
-			break;
+/**
+ * @brief Takes a snapshot of every shard, all of the same point in time. Every shard is
+ * locked shared at once, and the shards whose snapshot is current are let go first. Only
+ * the shards that changed since their last snapshot are copied, by the list's worker
+ * threads at the same time, and each round of copies lets go of its shards as soon as it
+ * is done. A writer thus waits for the copy of about one shard, not of the whole list.
+ *
+ * @attention Use snapshot_release() to release each snapshot.
+ *
+ * @param server
+ * @param snapshots receives the snapshot of each shard
+ * @return 0 if successful, error code otherwise
+ */
+int snapshot_acquire(Server *server, Snapshot **snapshots) {
+	int count = server -> shard_count;
+	int err = 0;
+
+	// Lazy shards must be sorted first, under the exclusive locks
+	server_lock_all(server, FALSE);
+	int ready = TRUE;
+	for (int i = 0; i < count; i++) {
+		if (!query_ready(server -> shards[i].students_head, LIST)) ready = FALSE;
+	}
+	if (!ready) {
+		server_unlock_all(server);
+		server_lock_all(server, TRUE);
+		for (int i = 0; i < count && !err; i++) {
+			err = ensure_sorted(server -> shards[i].students_head);
+		}
+	}
+
+	// LOAD replaces the shards' lists, so they are only read under the locks
+	int workers = list_of(server -> shards[0].students_head) -> workers;
+	if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+	if (workers < 1) workers = 1;
+
+	SnapshotJob jobs[MAX_SHARDS];
+	int changed = 0;
+	for (int i = 0; i < count; i++) {
+		Shard *shard = &server -> shards[i];
+		snapshots[i] = err ? NULL : shard_snapshot(shard, FALSE, &err);
+		if (snapshots[i] != NULL) pthread_rwlock_unlock(&shard -> lock);
+		else {
+			jobs[changed].shard = shard;
+			jobs[changed].snapshot = NULL;
+			jobs[changed++].err = 0;
+		}
+	}
+
+	for (int done = 0; done < changed; ) {
+		int round = (changed - done < workers) ? changed - done : workers;
+		if (!err) run_parallel(snapshot_job, jobs + done, sizeof(SnapshotJob), round);
+
+		for (int i = done; i < done + round; i++) {
+			snapshots[jobs[i].shard - server -> shards] = jobs[i].snapshot;
+			if (!err) err = jobs[i].err;
+			pthread_rwlock_unlock(&jobs[i].shard -> lock);
+		}
+		done += round;
 	}
 
-	free_parsed_input(parsed_inp);
+	for (int i = 0; i < count && err; i++) {    // Handle error: release what was taken
+		if (snapshots[i] != NULL) snapshot_release(&server -> shards[i], snapshots[i]);
+	}
 	return err;
 }
 
 /**
- * @brief Prints information to stdout about the given error code.
+ * @brief Releases a reader's reference to a snapshot of a shard. The last reference frees
+ * it.
  *
- * @param err_code
+ * @param shard the shard that the snapshot is of
+ * @param snapshot
+ */
+void snapshot_release(Shard *shard, Snapshot *snapshot) {
+	pthread_mutex_lock(&shard -> snapshot_lock);
+	int readers = --snapshot -> readers;
+	pthread_mutex_unlock(&shard -> snapshot_lock);
+
+	if (readers == 0) snapshot_free(snapshot);
+}
+
+/**
+ * @brief Frees a snapshot and its copy of the list.
  *
- * @note Error messages are defined in err_codes[]
+ * @param snapshot
  */
-void print_error(int err_code) {
-	// Holds the head and error message
-	const char *head = NULL;
-	const char *msg = NULL;
+void snapshot_free(Snapshot *snapshot) {
+	free_linked_list(snapshot -> students_head);
+	free(snapshot);
+}
 
-	// Search for the matching code
-	for (int i = 0; i < NUM_ERRORS; i++) {
-		if (err_codes[i].code == err_code) {
-			head = err_codes[i].head;
-			msg = err_codes[i].msg;
-			break;
+/**
+ * @brief Handles a client the event loop found ready. Output left over from the previous
+ * time is sent first; only when all of it is gone are new commands received and run, so a
+ * client that doesn't read its output stops being served instead of holding up a worker.
+ * The client is then re-armed in the event loop, waiting to be writable if output is
+ * still pending and readable otherwise, or closed once it is done.
+ *
+ * @param server
+ * @param client
+ */
+void server_serve(Server *server, Client *client) {
+	int ok = client_flush(client);
+	if (ok && client -> out == NULL && !client -> closing) {
+		int hung_up = !client_receive(client);
+		if (hung_up) client -> closing = TRUE;
+		ok = client_run_input(server, client, hung_up) && client_flush(client);
+	}
+
+	struct epoll_event event;
+	event.events = ((client -> out != NULL) ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+	event.data.ptr = client;
+	if (!ok || (client -> closing && client -> out == NULL)
+		|| epoll_ctl(server -> epoll_fd, EPOLL_CTL_MOD, client -> fd, &event) < 0) {
+		client_close(server, client);
+	}
+}
+
+/**
+ * @brief Worker thread of a server: serves clients from the ready queue until the server
+ * stops.
+ *
+ * @param arg pointer to the Server
+ * @return NULL
+ */
+void *server_worker(void *arg) {
+	Server *server = arg;
+	Client *client;
+	while ((client = server_dequeue(server)) != NULL) server_serve(server, client);
+	return NULL;
+}
+
+/**
+ * @brief Signal handler that asks the server to shut down.
+ *
+ * @param sig
+ */
+void server_stop_signal(int sig) {
+	(void)sig;
+	server_stop_requested = 1;
+}
+
+/**
+ * @brief Serves the list to clients connecting to a Unix domain socket in the given path,
+ * until SIGINT or SIGTERM. Each client speaks the same line protocol as stdin; the output
+ * of its commands is sent back to it. The list's worker threads serve the clients, and
+ * the journal, if any, is synced every JOURNAL_SYNC_MS by the event loop.
+ *
+ * @param students_head pointer to the head of the linked list
+ * @param path file name of the socket
+ * @param shard_count number of shards to split the list into, 1 to MAX_SHARDS; must be 1
+ * if the list has a journal
+ * @return exit status of the program
+ */
+int run_server(Student *students_head, const char *path, int shard_count) {
+	Server server;
+	int err = server_open(&server, students_head, path, shard_count);
+	if (err) {  // Handle error
+		print_error(err);
+		return EXIT_FAILURE;
+	}
+
+	/* The stop signals are blocked everywhere except inside epoll_pwait(), so that they
+	always interrupt the event loop rather than a worker */
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = server_stop_signal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	sigset_t stop_signals, wait_mask;
+	sigemptyset(&stop_signals);
+	sigaddset(&stop_signals, SIGINT);
+	sigaddset(&stop_signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop_signals, &wait_mask);
+
+	int workers = list_of(students_head) -> workers;
+	if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+	if (workers < 1) workers = 1;
+	pthread_t threads[MAX_WORKERS];
+	int started = 0;
+	for (; started < workers; started++) {
+		if (pthread_create(&threads[started], NULL, server_worker, &server)) break;
+	}
+	if (started == 0) err = ERR_CRITICAL;   // Handle error
+
+	Journal *journal = list_of(students_head) -> journal;
+	long long next_sync = monotonic_ms() + JOURNAL_SYNC_MS;
+	struct epoll_event events[SERVER_MAX_EVENTS];
+
+	while (!err && !server_stop_requested) {
+		int n = epoll_pwait(server.epoll_fd, events, SERVER_MAX_EVENTS,
+			(journal != NULL) ? JOURNAL_SYNC_MS : -1, &wait_mask);
+		if (n < 0 && errno != EINTR) err = ERR_SERVER_SOCKET;   // Handle error
+
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.ptr == NULL) {
+				int accept_err = server_accept(&server);
+				if (accept_err) print_error(accept_err);
+			}
+			else server_enqueue(&server, events[i].data.ptr);
+		}
+
+		// Sync the journal's pending records at least every JOURNAL_SYNC_MS
+		if (journal != NULL && monotonic_ms() >= next_sync) {
+			pthread_rwlock_wrlock(&server.shards[0].lock);
+			int sync_err = journal_sync(journal);
+			pthread_rwlock_unlock(&server.shards[0].lock);
+			if (sync_err) print_error(sync_err);
+			next_sync = monotonic_ms() + JOURNAL_SYNC_MS;
 		}
 	}
 
-	// Print error
-	printf("ERROR (%d) %s: %s\n", err_code, head, msg);
+	// Stop the workers; clients still in the queue are closed by server_close()
+	pthread_mutex_lock(&server.queue_lock);
+	server.stopping = TRUE;
+	pthread_cond_broadcast(&server.queue_cond);
+	pthread_mutex_unlock(&server.queue_lock);
+	for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+	int sync_err = journal_sync(journal);
+	if (sync_err) print_error(sync_err);
+
+	server_close(&server);
+	pthread_sigmask(SIG_SETMASK, &wait_mask, NULL);
+
+	if (err) print_error(err);
+	return err ? EXIT_FAILURE : EXIT_SUCCESS;
 }
+#endif
+
+int main(int argc, char *argv[]) {
+	#if defined(BENCH)     // Only for benchmarking
+	return bench(argc, argv);
+
+	#elif !defined(TEST)   // Only for testing purposes
+
+	/* Batch mode unless stdin is a terminal, "-b" and "-i" force batch/interactive mode.
+	"-l" turns on lazy ordering, "-t <n>" sets the number of worker threads, "-j <file>"
+	keeps a journal (and its snapshot) in the given file and "-s <socket>" serves clients
+	of a Unix domain socket instead of reading stdin (Linux only), with the list split
+	into "-n <shards>" shards. */
+	int batch = !stdin_is_tty();
+	int lazy = FALSE;
+	int workers = 0;    // 0: default_workers()
+	char *journal_path = NULL;
+	#ifdef __linux__
+	char *socket_path = NULL;
+	int shards = 1;
+	#endif
+	for (int i = 1; i < argc; i++) {
+		if      (strcmp(argv[i], "-b") == 0) batch = TRUE;
+		else if (strcmp(argv[i], "-i") == 0) batch = FALSE;
+		else if (strcmp(argv[i], "-l") == 0) lazy = TRUE;
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc
+			&& (workers = validate_int_input(argv[i + 1], FALSE)) >= 1) i++;
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) journal_path = argv[++i];
+		#ifdef __linux__
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) socket_path = argv[++i];
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc
+			&& (shards = validate_int_input(argv[i + 1], FALSE)) >= 1
+			&& shards <= MAX_SHARDS) i++;
+		#endif
+		else {
+			fprintf(stderr, "Usage: %s [-b | -i | -s <socket> [-n <shards>]] [-l] "
+				"[-t <threads>] [-j <journal>]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
 
-int main(void) {
-	#ifndef TEST   // Only for testing purposes
+	#ifdef __linux__
+	if (shards > 1 && journal_path != NULL) {
+		fprintf(stderr, "A journal can only be kept with one shard\n");
+		return EXIT_FAILURE;
+	}
+	#endif
 
 	/* Initializes linked list. If init is unsuccessful, tries again repeatedly up to 10
 	times. If init still unsuccessful, gives up and exits the program. */
@@ -914,27 +5170,32 @@ int main(void) {
 		students_head = init_linked_list();
 	}
 	if (students_head == NULL) return ERR_CRITICAL;
+	set_lazy_ordering(students_head, lazy);
+	if (workers > 0) list_of(students_head) -> workers = workers;
 
-	char input[INPUT_BUFFER_SIZE];      // Input buffer
-	int ret = 0;                        // Holds return value from run()
-
-	// Main program loop
-	while (ret != QUIT_FLAG) {
-		if (fgets(input, sizeof(input), stdin) != NULL) {   // Read user input from stdin
-			ret = run(input, students_head);                // Attempt to run user input
-		}
-		else {
-			ret = ERR_NON_VIABLE_INP;
+	// Restore the state kept in the journal
+	if (journal_path != NULL) {
+		int err = journal_open(students_head, journal_path);
+		if (err) {  // Handle error
+			print_error(err);
+			free_linked_list(students_head);
+			return EXIT_FAILURE;
 		}
-
-		// Prints possible error message
-		if (ret < 0) print_error(ret);
 	}
 
+	#ifdef __linux__
+	int status = (socket_path != NULL) ? run_server(students_head, socket_path, shards)
+		: batch ? run_batch(students_head) : run_interactive(students_head);
+	#else
+	int status = batch ? run_batch(students_head) : run_interactive(students_head);
+	#endif
+
 	free_linked_list(students_head);
-	return 0;
+	return status;
 
 	#else
+	(void)argc;
+	(void)argv;
 	test();
 	return 0;
 	#endif
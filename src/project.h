@@ -9,9 +9,33 @@
 #define STDNT_ID_LEN 6          // Student ID length, not including '\0'
 #define EXCRS_RNDS 6            // Number of excercise rounds
 #define EXCRS_PTS 999           // Maximum amount of points per round
+#define MAX_TOTAL_PTS (EXCRS_RNDS * EXCRS_PTS) // Maximum amount of total points
+#define SORT_KEY_NAME_BYTES 6   // Leading last name bytes packed into Student.sort_key
 #define QUIT_FLAG 1
 #define NO_CMND_CHAR '*'        // Flag to denote no viable command in Input struct
 #define INT_ERR_BOUND (INT_MIN+10) // Nums below this (very small) num are considered errors
+#define ID_INDEX_INIT_CAP 64    // Initial number of slots in the student ID index (power of 2)
+#define BATCH_READ_SIZE (1 << 20)   // Size of one block read from stdin in batch mode
+#define BATCH_WRITE_SIZE (1 << 20)  // Size of the stdout buffer in batch mode
+#define FORMAT_BUFFER_SIZE 65536    // Size of the buffer that L and W format records into
+#define PARALLEL_MIN_RECORDS 65536  // Lists shorter than this are sorted and written by one thread
+#define PARALLEL_CHUNK_RECORDS 16384 // Records formatted by one worker job
+#define PARALLEL_MIN_BYTES 1048576  // Text files smaller than this are parsed by one thread
+#define MAX_WORKERS 64          // Maximum number of worker threads
+#define MAX_SHARDS 64           // Maximum number of shards of the server's list
+#define TREE_MAX_HEIGHT 64      // Bound on the height of a Tree, far above any AVL tree's
+#define STATS_BUCKETS 64        // Latency histogram buckets: bucket b counts b-bit ns values
+#define STATS_COMMANDS 26       // Command statistics slots, one per capital letter
+#define JOURNAL_SYNC_RECORDS 256    // Journal records collected before they are synced to disk
+#define JOURNAL_SYNC_MS 100     // Longest time a journal record waits to be synced (ms)
+#define JOURNAL_COMPACT_MIN 65536   // Journal records before compaction is considered
+#define JOURNAL_TEMP_EXT ".tmp"     // Suffix of a journal or its snapshot while it is written
+#define JOURNAL_EPOCH 'J'       // Starts the header line of a journal, followed by its epoch
+#define POOL_SLAB_STUDENTS 256  // Number of Student nodes in one slab of a StudentPool
+#define POOL_BLOCK_SIZE 65536   // Size of one name block of a StudentPool in bytes
+#define SERVER_BACKLOG 64       // Connections the server socket queues before accepting them
+#define SERVER_READ_SIZE 65536  // Bytes read from a client at a time
+#define SERVER_MAX_EVENTS 64    // Socket events handled per round of the server event loop
 
 // Error codes
 #define ERR_UNKNOWN -1          // Generic error code
@@ -36,9 +60,13 @@
 #define ERR_FILE_CORR -53       // File could not be parsed successfully
 #define ERR_FILENAME_INV -54    // Filename invalid
 #define ERR_FILENAME_LEN -55    // Filename too long
+#define ERR_FILE_CRC -56        // File checksum does not match its contents
+#define ERR_FILE_WRITE -57      // Writing to file failed
+#define ERR_JOURNAL_WRITE -58   // Writing to the journal or its snapshot failed
 #define ERR_ID_TOO_LONG -60     // Given student ID is too long
 #define ERR_ID_EMPTY -61        // Given student ID is empty
 #define ERR_ID_NOT_ALNUM -62    // Given student ID is not alphanumeric
+#define ERR_SERVER_SOCKET -70   // Server socket could not be set up
 #define ERR_INT_CNV (INT_MIN)   // Conversion of str to int not possible
 #define ERR_INT_OOB (INT_MIN+1) // Given number out-of-bounds for int type
 #define ERR_INT_NEG (INT_MIN+2) // Given int is neg when only pos is allowed
@@ -51,50 +79,537 @@
 #define WRITE_ARGS 2    // WRITE: <'W'> <file name>
 #define LOAD_ARGS 2     // LOAD: <'O'> <file name>
 #define QUIT_ARGS 1     // QUIT: <'Q'>
+#define STATS_ARGS 1    // STATS: <'S'>
+#define TOP_ARGS 2      // TOP: <'T'> <count>
+#define RANK_ARGS 2     // RANK: <'R'> <student ID>
+#define RANGE_ARGS 3    // RANGE: <'P'> <min total> <max total>
+#define NAME_ARGS 2     // NAME: <'N'> <last name prefix>
+#define BATCH_ARGS 2    // BATCH: <'B'> <file name>
+#define BATCH_FIELDS 3  // BATCH FILE: <ID> <round> <points>
 #define MAX_ARGS 10     // FILE: <ID> <lname> <fname> <rnd1> ... <rnd6> <totalpts>
 
+/* Binary snapshot format, used by W for file names ending in BINARY_EXT and detected by O
+from the magic. All integers are little-endian.
+	header:  <magic 4B> <version u16> <rounds u16> <count u32> <string bytes u32> <epoch u32>
+	points:  count * rounds * <points u16>, in list order
+	strings: count * (<id len u8> <id> <lname len u32> <lname> <fname len u32> <fname>)
+	trailer: <CRC-32 of everything before it u32>
+The epoch is the journal epoch of a journal snapshot (see Journal) and 0 for files written
+by W. Version 1 files have no epoch in their header, which is BINARY_V1_HEADER_SIZE long. */
+#define BINARY_EXT ".sdb"       // File name suffix that makes W write a binary snapshot
+#define BINARY_MAGIC "SPDB"     // First bytes of a binary snapshot
+#define BINARY_VERSION 2
+#define BINARY_HEADER_SIZE 20
+#define BINARY_V1_HEADER_SIZE 16
+#define BINARY_TRAILER_SIZE 4
+
 #include <stdio.h>
+#include <stddef.h>
+
+struct student;
+
+/**
+ * @brief Links that place one Student into one balanced (AVL) tree. Embedded in Student, so
+ * the trees need no allocations of their own.
+ *
+ * @param left subtree of Students that come before this one
+ * @param right subtree of Students that come after this one
+ * @param height height of the subtree rooted at this Student
+ * @param size number of Students in the subtree rooted at this Student
+ */
+typedef struct {
+	struct student *left;
+	struct student *right;
+	int height;
+	int size;
+} TreeLink;
 
 /**
  * @brief Student info stored as a linked list. The first "Student" in the linked list is
- * permanently fixed dummy that is denoted by setting student_id, lastname and firstname to
- * NULL.
+ * permanently fixed dummy that is denoted by an empty student_id, with lastname and
+ * firstname set to NULL.
+ *
+ * The fields that sort_students() reads come first, so that comparing two Students mostly
+ * touches one cache line of each.
  * 
- * @param student_id
- * @param lastname
- * @param firstname
+ * @param sort_key packed (MAX_TOTAL_PTS - total, first SORT_KEY_NAME_BYTES bytes of last
+ * name). A smaller key sorts first; equal keys fall back to string comparison.
+ * @param total sum of points, kept up to date by update_points()
+ * @param student_id stored in the Student itself
+ * @param lastname points into the name arena of the pool
+ * @param firstname points into the name arena of the pool
  * @param points array of size EXCRS_RNDS that contains points for each round
  * @param next pointer to next Student node
+ * @param prev pointer to previous Student node (the dummy head for the first Student)
+ * @param rank_link links into the ranking tree, which orders Students by sort_students()
+ * @param name_link links into the name index, which orders Students by sort_names()
  * 
  * @attention Initialize the linked list by calling init_linked_list() to create the dummy
  * node and pointer to it.
  */
 typedef struct student {
-	char *student_id;
+	unsigned long long sort_key;
+	int total;
+	char student_id[STDNT_ID_LEN + 1];
 	char *lastname;
 	char *firstname;
 	int points[EXCRS_RNDS];
 	struct student *next;
+	struct student *prev;
+	TreeLink rank_link;
+	TreeLink name_link;
 } Student;
 
+/**
+ * @brief Order-statistic AVL tree of Students. The tree is generic over which TreeLink of
+ * the Student it uses and how Students are ordered.
+ *
+ * @param root root Student of the tree, NULL if the tree is empty
+ * @param link_offset offset of the TreeLink used by this tree inside Student
+ * @param cmp ordering of the tree: <0 if a before b, >0 if b before a
+ */
+typedef struct {
+	struct student *root;
+	size_t link_offset;
+	int (*cmp)(struct student *a, struct student *b);
+} Tree;
+
+/**
+ * @brief Hash index that maps student IDs to Student nodes. Uses open addressing with
+ * linear probing. Students are never removed one by one, so no tombstones are needed: the
+ * whole index is either cleared or free'd at once.
+ *
+ * @param slots array of size capacity, NULL marks an empty slot
+ * @param capacity number of slots, always zero or a power of two
+ * @param count number of Students stored in the index
+ */
+typedef struct {
+	Student **slots;
+	size_t capacity;
+	size_t count;
+} IdIndex;
+
+/**
+ * @brief One slab of Student nodes in a StudentPool.
+ *
+ * @param next next (older) slab
+ * @param used number of nodes handed out from this slab
+ * @param nodes
+ */
+typedef struct student_slab {
+	struct student_slab *next;
+	int used;
+	Student nodes[POOL_SLAB_STUDENTS];
+} StudentSlab;
+
+/**
+ * @brief One block of the name arena of a StudentPool. Names are bump-allocated from data.
+ *
+ * @param next next (older) block
+ * @param used number of bytes handed out from data
+ * @param size size of data in bytes
+ * @param data
+ */
+typedef struct name_block {
+	struct name_block *next;
+	size_t used;
+	size_t size;
+	char data[];
+} NameBlock;
+
+/**
+ * @brief Allocator for the Students of one list and their long names. Student nodes come
+ * from slabs and names from a bump arena, so allocating is mostly a pointer bump. Memory is
+ * only given back all at once by pool_release().
+ *
+ * @param slabs Student slabs, newest first
+ * @param free_nodes Student nodes returned by free_student(), linked through "next"
+ * @param names name arena blocks, the one being filled first
+ */
+typedef struct {
+	StudentSlab *slabs;
+	Student *free_nodes;
+	NameBlock *names;
+} StudentPool;
+
+/**
+ * @brief Write-ahead journal of a list. Every successful ADD and UPDATE is appended to the
+ * journal file as a command line, and the records are synced to disk in groups. On startup
+ * the journal is replayed on top of the last snapshot, and it is compacted into a new
+ * snapshot when it grows as large as the list.
+ *
+ * Every compaction starts a new epoch, which is written into the header of both the new
+ * snapshot and the new journal. A journal is only replayed onto the snapshot of its own
+ * epoch, so a crash between swapping in a snapshot and starting the journal over can't
+ * replay records that the snapshot already replaced.
+ *
+ * @param file journal file, opened for appending
+ * @param path file name of the journal
+ * @param snapshot_path file name of the snapshot, path followed by BINARY_EXT
+ * @param temp_path file name of a snapshot being written, snapshot_path followed by
+ * JOURNAL_TEMP_EXT
+ * @param restart_path file name of the journal of the next epoch while it is written, path
+ * followed by JOURNAL_TEMP_EXT
+ * @param pending number of records written but not yet synced
+ * @param pending_since time of the oldest pending record, see monotonic_ms()
+ * @param records number of records in the journal file
+ * @param epoch epoch of the current snapshot and journal file
+ *
+ * @note Initialized by journal_open(), released by journal_close()
+ */
+typedef struct {
+	FILE *file;
+	char *path;
+	char *snapshot_path;
+	char *temp_path;
+	char *restart_path;
+	int pending;
+	long long pending_since;
+	long records;
+	unsigned long epoch;
+} Journal;
+
+/**
+ * @brief The permanent dummy head of the linked list together with the indexes that are
+ * kept in sync with the list. init_linked_list() allocates a ListHead and returns a
+ * pointer to its "node" member, so every function that takes "students_head" can reach the
+ * indexes without changing its signature.
+ *
+ * @param node dummy head node of the linked list (must be the first member)
+ * @param id_index student ID -> Student lookup table
+ * @param rank_tree Students ordered by sort_students(), mirrors the order of the list
+ * @param pool allocator that owns all Students of the list and their strings
+ * @param lazy TRUE if the list is only sorted when it is read (lazy ordering mode)
+ * @param dirty TRUE if the list and ranking tree are out of order (only in lazy mode)
+ * @param workers number of threads used to sort and write long lists
+ * @param journal journal of the changes to the list, NULL if there is none
+ * @param name_index Students ordered by sort_names(), for last name searches
+ * @param names_stale TRUE if name_index is out of date and must be rebuilt before use
+ */
+typedef struct {
+	Student node;
+	IdIndex id_index;
+	Tree rank_tree;
+	StudentPool pool;
+	int lazy;
+	int dirty;
+	int workers;
+	Journal *journal;
+	Tree name_index;
+	int names_stale;
+} ListHead;
+
+/**
+ * @brief Binary min-heap of the next Students of sorted runs, ordered by a comparison
+ * function. Used to merge shards, see merge_init(), merge_push() and merge_pop().
+ *
+ * @param heads next Student of each run that has not ended, heap ordered
+ * @param runs number of the run of each Student in heads
+ * @param count number of runs that have not ended
+ * @param cmp order of the merged Students
+ */
+typedef struct {
+	Student *heads[MAX_SHARDS];
+	int runs[MAX_SHARDS];
+	int count;
+	int (*cmp)(Student *a, Student *b);
+} MergeHeap;
+
+/**
+ * @brief In-order iterator over a Tree. Holds the path of nodes whose own turn and right
+ * subtree are still to come, the next node on top.
+ *
+ * @param tree
+ * @param path pending nodes, path[depth - 1] is the next one
+ * @param depth number of pending nodes
+ */
+typedef struct {
+	Tree *tree;
+	Student *path[TREE_MAX_HEIGHT];
+	int depth;
+} TreeIter;
+
+/**
+ * @brief One part of a parallel sort: either sorting src[lo..hi) in place, or merging the
+ * sorted runs src[lo..mid) and src[mid..hi) into dst[lo..hi).
+ */
+typedef struct {
+	Student **src;
+	Student **dst;
+	int lo;
+	int mid;
+	int hi;
+} SortJob;
+
+/**
+ * @brief One part of a parallel write: count Students starting from first, or the count
+ * Students of an array when several lists are merged, formatted into a buffer of the job's
+ * own.
+ *
+ * @param first first Student of the part
+ * @param students the Students of the part in order, NULL to follow first's "next" instead
+ * @param count number of Students in the part
+ * @param buf formatted records, grows as needed
+ * @param len number of bytes used in buf
+ * @param cap size of buf
+ * @param err error code of the job, 0 if successful
+ */
+typedef struct {
+	Student *first;
+	Student **students;
+	int count;
+	char *buf;
+	size_t len;
+	size_t cap;
+	int err;
+} FormatJob;
+
 /**
  * @brief One instance of Input struct holds either one parsed line of user given input, or
  * one parsed line read from a file.
  * 
  * @param arg_count number of arguments found in input string (including command char)
  * @param cmnd holds a valid command character, NO_CMND_CHAR if input comes from FILE
- * @param arg_arr pointer to an array that holds all found arguments (includes the command
- * character, if present)
+ * @param arg_arr array of the first MAX_ARGS found arguments (includes the command
+ * character, if present). The arguments point into the parsed input string.
+ * @param arg_len lengths of the arguments in arg_arr
  * 
- * @note Initialized by parse_input()
- * @note Dynamically allocated memory free'd by free_parsed_input()
+ * @note Initialized by parse_input(), owns no dynamically allocated memory
  */
 typedef struct {
 	int arg_count;
 	char cmnd;
 	char *arg_arr[MAX_ARGS];
+	size_t arg_len[MAX_ARGS];
 } Input;
 
+/**
+ * @brief A run of characters that is not necessarily '\0'-terminated, e.g. one token of a
+ * line inside a memory-mapped file.
+ *
+ * @param start pointer to the first character
+ * @param len number of characters
+ */
+typedef struct {
+	const char *start;
+	size_t len;
+} Span;
+
+/**
+ * @brief Read-only view of the whole contents of a file. The contents are memory-mapped
+ * where mmap() is available, and read into a dynamically allocated buffer elsewhere.
+ *
+ * @param data pointer to the file contents, NULL for an empty file
+ * @param size size of the file contents in bytes
+ * @param mapped TRUE if data is memory-mapped, FALSE if allocated
+ *
+ * @note Initialized by open_file_view(), released by close_file_view()
+ */
+typedef struct {
+	char *data;
+	size_t size;
+	int mapped;
+} FileView;
+
+/**
+ * @brief Students parsed by load_file() before they replace the old list.
+ *
+ * @param rows array of loaded Students in file order
+ * @param count number of Students in rows
+ * @param capacity allocated size of rows
+ * @param index ID index of the loaded Students, used to reject duplicate IDs
+ * @param pool allocator of the loaded Students
+ *
+ * @note Released by load_buffer_free() unless handed over to the list
+ */
+typedef struct {
+	Student **rows;
+	int count;
+	int capacity;
+	IdIndex index;
+	StudentPool pool;
+} LoadBuffer;
+
+/**
+ * @brief One validated line of a batch update file, see batch_update().
+ *
+ * @param student Student to update
+ * @param list number of the Student's list, see batch_update()
+ * @param round round number, 1 to EXCRS_RNDS
+ * @param points new points of the round
+ */
+typedef struct {
+	Student *student;
+	int list;
+	int round;
+	int points;
+} PointChange;
+
+/**
+ * @brief One chunk of a text file parsed by parse_text_parallel(). A chunk starts at the
+ * beginning of a line and ends after a newline or at the end of the file.
+ *
+ * @param start first byte of the chunk
+ * @param end byte after the chunk
+ * @param buffer rows and pool of the Students parsed from the chunk, its index is unused
+ * @param err error code of the first bad line of the chunk, 0 if none; the rows before it
+ * are kept in buffer
+ */
+typedef struct {
+	const char *start;
+	const char *end;
+	LoadBuffer buffer;
+	int err;
+} ParseJob;
+
+/**
+ * @brief Reads lines from a stream in large blocks. Lines are handed out in place, inside
+ * the block buffer, so reading a line copies nothing.
+ *
+ * @param stream stream to read from
+ * @param buf block buffer, one byte larger than capacity for the '\0' after the last line
+ * @param capacity size of the buffer, grows for lines that don't fit
+ * @param start offset of the next unread line
+ * @param end offset after the last byte read into the buffer
+ * @param saved character overwritten by the '\0' after the previous line
+ * @param saved_pos offset of the overwritten character
+ *
+ * @note Initialized by line_reader_init(), released by line_reader_free()
+ */
+typedef struct {
+	FILE *stream;
+	char *buf;
+	size_t capacity;
+	size_t start;
+	size_t end;
+	char saved;
+	size_t saved_pos;
+} LineReader;
+
+// Server mode is built on epoll, which only Linux has
+#ifdef __linux__
+#include <pthread.h>
+
+/**
+ * @brief A connection to a server client. A client is only handled by one thread at a time:
+ * its socket is registered to the event loop with EPOLLONESHOT, so after the loop hands the
+ * client to a worker it gets no more events until the worker re-arms it.
+ *
+ * @param fd socket of the connection
+ * @param in received bytes whose commands have not been run yet, one byte larger than
+ * capacity for the '\0' after a line
+ * @param len number of bytes in "in"
+ * @param capacity size of "in", grows for lines that don't fit
+ * @param out output not sent yet, NULL if none
+ * @param out_len number of bytes in "out"
+ * @param out_sent number of bytes of "out" already sent
+ * @param closing TRUE if no more commands are run: the client has hung up or sent QUIT
+ * @param next_ready next client in the queue of clients waiting for a worker
+ * @param prev previous connected client
+ * @param next next connected client
+ */
+typedef struct client {
+	int fd;
+	char *in;
+	size_t len;
+	size_t capacity;
+	char *out;
+	size_t out_len;
+	size_t out_sent;
+	int closing;
+	struct client *next_ready;
+	struct client *prev;
+	struct client *next;
+} Client;
+
+/**
+ * @brief A point-in-time copy of one shard. LIST and WRITE in server mode read the
+ * snapshots of every shard, so that they don't hold the shards' locks while formatting and
+ * writing the whole list. A shard's snapshot is shared by every reader until the shard
+ * changes, and freed when the shard has moved on to a newer version and the last reader
+ * has released it.
+ *
+ * @param students_head pointer to the head of the copied list
+ * @param version version of the shard that was copied, see Shard
+ * @param readers number of references: readers plus the shard while it is current
+ */
+typedef struct {
+	Student *students_head;
+	unsigned long version;
+	int readers;
+} Snapshot;
+
+/**
+ * @brief One part of the server's list, holding the Students whose shard_of() it is.
+ *
+ * @param students_head pointer to the head of the shard's linked list
+ * @param lock readers-writer lock of the shard
+ * @param version number of commands that may have changed the shard, under "lock"
+ * @param snapshot latest snapshot of the shard, NULL if none
+ * @param snapshot_lock lock of "snapshot" and the reference counts of the shard's snapshots
+ */
+typedef struct {
+	Student *students_head;
+	pthread_rwlock_t lock;
+	unsigned long version;
+	Snapshot *snapshot;
+	pthread_mutex_t snapshot_lock;
+} Shard;
+
+/**
+ * @brief Copy of one shard into a new Snapshot, run by a worker thread of
+ * snapshot_acquire().
+ *
+ * @param shard shard to copy, locked by the caller
+ * @param snapshot receives the snapshot
+ * @param err error code of the job, 0 if successful
+ */
+typedef struct {
+	Shard *shard;
+	Snapshot *snapshot;
+	int err;
+} SnapshotJob;
+
+/**
+ * @brief State of the server mode. The event loop accepts connections and queues clients
+ * that have input, and the worker threads run their commands.
+ *
+ * The list is split into shards by student ID, each with its own lock. ADD and UPDATE
+ * only lock their Student's shard exclusively, so changes to different shards run in
+ * parallel. BATCH locks the shards of its changes, and LOAD every shard. LIST and WRITE
+ * merge the Snapshots of the shards, see snapshot_acquire(). The other queries (see
+ * is_query()) hold the locks of the shards shared and merge their answers from the
+ * shards' trees, see server_run_query().
+ *
+ * @param shards the shards, shard_count of them
+ * @param shard_count number of shards, 1 keeps the list passed to server_open() as is
+ * @param path file name of the socket
+ * @param listen_fd listening socket
+ * @param epoll_fd event loop
+ * @param queue_lock lock of the ready queue, the client list and "stopping"
+ * @param queue_cond signaled when a client is queued or the server is stopping
+ * @param ready_head first client in the ready queue
+ * @param ready_tail last client in the ready queue
+ * @param clients connected clients, for closing them when the server stops
+ * @param stopping TRUE when the workers should exit
+ *
+ * @note Initialized by server_open(), released by server_close()
+ */
+typedef struct {
+	Shard shards[MAX_SHARDS];
+	int shard_count;
+	const char *path;
+	int listen_fd;
+	int epoll_fd;
+	pthread_mutex_t queue_lock;
+	pthread_cond_t queue_cond;
+	Client *ready_head;
+	Client *ready_tail;
+	Client *clients;
+	int stopping;
+} Server;
+#endif
+
 /**
  * @brief One ErrorCode instance pairs an error code to an error message.
  */
@@ -128,9 +643,13 @@ ErrorCode err_codes[] = {
 	{ERR_FILE_CORR,         "ERR_FILE_CORR",        "File corruption."},
 	{ERR_FILENAME_INV,      "ERR_FILENAME_INV",     "File name is invalid."},
 	{ERR_FILENAME_LEN,      "ERR_FILENAME_LEN",     "File name is too long."},
+	{ERR_FILE_CRC,          "ERR_FILE_CRC",         "File checksum mismatch, the file is corrupted."},
+	{ERR_FILE_WRITE,        "ERR_FILE_WRITE",       "File could not be written."},
+	{ERR_JOURNAL_WRITE,     "ERR_JOURNAL_WRITE",    "Journal could not be written, the change is not durable."},
 	{ERR_ID_TOO_LONG,       "ERR_ID_TOO_LONG",      "Given student ID is too long."},
 	{ERR_ID_EMPTY,          "ERR_ID_EMPTY",         "Given student ID is empty."},
 	{ERR_ID_NOT_ALNUM,      "ERR_ID_NOT_ALNUM",     "Given student ID contains symbols other than letters and numbers."},
+	{ERR_SERVER_SOCKET,     "ERR_SERVER_SOCKET",    "Server socket could not be set up."},
 	{ERR_INT_CNV,           "ERR_INT_CNV",          "Conversion of str to int not possible."},
 	{ERR_INT_OOB,           "ERR_INT_OOB",          "Given number out of bounds for int type."},
 	{ERR_INT_NEG,           "ERR_INT_NEG",          "Given integer is negative when only positive integers are allowed."},
@@ -139,31 +658,260 @@ ErrorCode err_codes[] = {
 // Holds total number of error codes
 #define NUM_ERRORS ((int)(sizeof(err_codes) / sizeof(err_codes[0])))
 
+/**
+ * @brief Counters and latency histogram of one command.
+ *
+ * @param count number of times the command was run
+ * @param errors number of runs that ended in an error
+ * @param total_ns sum of the latencies
+ * @param hist latency histogram, bucket b counts latencies of b bits in ns, i.e. in
+ * [2^(b-1), 2^b) ns
+ */
+typedef struct {
+	long long count;
+	long long errors;
+	long long total_ns;
+	long long hist[STATS_BUCKETS];
+} CommandStats;
+
+/**
+ * @brief Runtime statistics of the program, printed by the STATS command. Updated by the
+ * threads that run commands through STATS_ADD(); work done on worker threads (parallel
+ * sorting) is not counted. Comparisons and placements happen too often to update shared
+ * counters each time, they are counted per thread in a LocalStats and added once per
+ * command by stats_flush().
+ *
+ * @param commands statistics of each command, indexed by command character - 'A'
+ * @param errors number of commands that failed with each error code, same order as err_codes
+ * @param comparisons number of calls to sort_students()
+ * @param placements number of calls to place_into_list()
+ * @param placement_nodes ranking tree nodes visited by place_into_list()
+ * @param record_bytes bytes of Student records printed by L and text W
+ */
+typedef struct {
+	CommandStats commands[STATS_COMMANDS];
+	long long errors[NUM_ERRORS];
+	long long comparisons;
+	long long placements;
+	long long placement_nodes;
+	long long record_bytes;
+} Stats;
+
+/**
+ * @brief Statistics counted by the thread running a command, see Stats.
+ *
+ * @param comparisons number of calls to sort_students()
+ * @param placements number of calls to place_into_list()
+ * @param placement_nodes ranking tree nodes visited by place_into_list()
+ */
+typedef struct {
+	long long comparisons;
+	long long placements;
+	long long placement_nodes;
+} LocalStats;
+
+/* Commands from several server clients update the statistics at the same time, so the
+counters are atomic where the compiler supports it, and LocalStats are kept per thread */
+#if defined(__GNUC__)
+#define STATS_ADD(counter, n) __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#define STATS_GET(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#define STATS_LOCAL __thread
+#else
+#define STATS_ADD(counter, n) ((counter) += (n))
+#define STATS_GET(counter) (counter)
+#define STATS_LOCAL
+#endif
+
 // All function prototypes, mostly included for testing purposes
-int count_arguments(char *input);
 int validate_int_input(char *str, int allow_neg);
 int validate_id(char *student_id);
+int validate_id_span(const char *student_id, size_t len);
 int validate_rounds(char *round_str);
 int validate_points(char *points_str);
 int validate_filename(char *filename);
-Input *parse_input(char *input, int *error, int user_input);
-void free_parsed_input(Input *parsed_inp);
+int parse_input(char *input, Input *parsed_inp, int user_input);
 char parse_command(char *input, int *error);
 int validate_input(Input *parsed_inp);
+int split_span(const char *line, size_t len, Span *tokens, int max_tokens);
+int parse_points_span(const char *str, size_t len);
+int parse_record(const char *line, size_t len, int has_newline, Span *fields, int *points);
 int count_points(Student *student);
+unsigned long long make_sort_key(int total, const char *lastname);
+int order_students(Student *a, Student *b);
 int sort_students(Student *a, Student *b);
+int sort_names(Student *a, Student *b);
 Student *init_linked_list(void);
-Student *init_student(char *student_id, char *lastname, char *firstname);
-void free_student(Student *student);
+ListHead *list_of(Student *students_head);
+unsigned long hash_id(const char *student_id);
+Student *id_index_find(IdIndex *index, const char *student_id);
+void id_slots_place(Student **slots, size_t capacity, Student *student);
+int id_index_insert(IdIndex *index, Student *student);
+void id_index_free(IdIndex *index);
+void tree_init(Tree *tree, size_t link_offset, int (*cmp)(Student *a, Student *b));
+TreeLink *tree_link(Tree *tree, Student *node);
+int tree_height(Tree *tree, Student *node);
+int tree_size(Tree *tree, Student *node);
+void tree_update(Tree *tree, Student *node);
+Student *tree_rotate_left(Tree *tree, Student *node);
+Student *tree_rotate_right(Tree *tree, Student *node);
+Student *tree_balance(Tree *tree, Student *node);
+Student *tree_insert_at(Tree *tree, Student *node, Student *student, Student **pred,
+	int *visited);
+Student *tree_insert(Tree *tree, Student *student, int *visited);
+Student *tree_build(Tree *tree, Student **sorted, int count);
+Student *tree_select(Tree *tree, int index);
+int tree_count_before(Tree *tree, Student *student);
+Student *tree_seek(Tree *tree, int (*before)(Student *node, const void *key),
+	const void *key);
+int tree_count_prefix(Tree *tree, int (*before)(Student *node, const void *key),
+	const void *key);
+void tree_iter_seek(TreeIter *iter, Tree *tree, int (*before)(Student *node, const void *key),
+	const void *key);
+Student *tree_iter_next(TreeIter *iter);
+Student *tree_remove_min(Tree *tree, Student *node, Student **min);
+Student *tree_remove_at(Tree *tree, Student *node, Student *student);
+void tree_remove(Tree *tree, Student *student);
+void pool_init(StudentPool *pool);
+Student *pool_alloc_student(StudentPool *pool);
+char *pool_alloc_string(StudentPool *pool, const char *str, size_t len);
+void pool_release(StudentPool *pool);
+void pool_merge(StudentPool *dst, StudentPool *src);
+Student *init_student(StudentPool *pool, char *student_id, char *lastname, char *firstname);
+Student *init_student_n(StudentPool *pool, const char *student_id, size_t id_len,
+	const char *lastname, size_t lastname_len, const char *firstname, size_t firstname_len);
+void free_student(StudentPool *pool, Student *student);
 void place_into_list(Student *student, Student *students_head);
+void remove_from_list(Student *student, Student *students_head);
 int add_student(char *student_id, char *lastname, char *firstname, Student *students_head);
-void free_linked_list(Student *student);
+void free_linked_list(Student *students_head);
+void merge_init(MergeHeap *heap, int (*cmp)(Student *a, Student *b));
+void merge_push(MergeHeap *heap, Student *student, int run);
+Student *merge_pop(MergeHeap *heap, int *run);
+void merge_lists(MergeHeap *heap, Student **firsts, int count);
+Student *merge_next(MergeHeap *heap);
+Student *merge_linked_lists(Student **heads, int count);
+int shard_of(const char *student_id, int count);
+int split_linked_list(Student *students_head, Student **shards, int count);
+void set_round_points(Student *student, int round, int points);
 int update_points(char *student_id, char *round, char *points, Student *students_head);
+void set_lazy_ordering(Student *students_head, int lazy);
+int default_workers(void);
+void run_parallel(void *(*job_fn)(void *), void *jobs, size_t job_size, int count);
+void *sort_job(void *arg);
+void *merge_job(void *arg);
+int parallel_sort(Student **arr, int count, int workers);
+int ensure_sorted(Student *students_head);
+int ensure_all_sorted(Student **heads, int lists);
+char *format_uint(char *dest, unsigned int val);
+size_t format_student(char *buf, size_t cap, Student *student);
 int print_to_stream(FILE *stream, Student *student);
+int write_merged(FILE *stream, MergeHeap *heap, int count);
+int write_records(FILE *stream, Student *first, int count);
+void *format_job(void *arg);
+int write_records_parallel(FILE *stream, Student **heads, int lists);
 int print_status(Student *students_head);
-int write_to_file(char *filename, Student *students_head);
+int print_status_to(FILE *stream, Student **heads, int lists);
+int print_top(FILE *stream, Student **heads, int lists, int count);
+int print_rank(FILE *stream, Student **heads, int lists, char *student_id);
+int total_above(Student *node, const void *key);
+int total_at_least(Student *node, const void *key);
+int print_range(FILE *stream, Student **heads, int lists, int min, int max);
+int ensure_name_index(Student *students_head);
+int match_name_prefix(Student *node, const void *key);
+int name_before_prefix(Student *node, const void *key);
+int print_names(FILE *stream, Student **heads, int lists, char *prefix);
+int write_to_file(char *filename, Student **heads, int lists);
+int compare_students(const void *a, const void *b);
+int compare_students_uncounted(const void *a, const void *b);
+int compare_names(const void *a, const void *b);
+void link_sorted(Student **sorted, int count, Student *students_head);
+unsigned long crc32_update(unsigned long crc, const unsigned char *data, size_t len);
+int has_binary_ext(const char *filename);
+void put_le(unsigned char *buf, unsigned long val, int bytes);
+unsigned long get_le(const unsigned char *buf, int bytes);
+int write_binary(FILE *file, Student **heads, int lists, unsigned long epoch);
+int open_file_view(const char *filename, FileView *view);
+void close_file_view(FileView *view);
+int load_buffer_reserve(LoadBuffer *buffer, int count);
+int load_buffer_append(LoadBuffer *buffer, const char *student_id, size_t id_len,
+	const char *lastname, size_t lastname_len, const char *firstname, size_t firstname_len,
+	const int *points);
+int load_buffer_add(LoadBuffer *buffer, const char *student_id, size_t id_len,
+	const char *lastname, size_t lastname_len, const char *firstname, size_t firstname_len,
+	const int *points);
+void load_buffer_free(LoadBuffer *buffer);
+int parse_text(FileView *view, LoadBuffer *buffer);
+void *parse_job(void *arg);
+int parse_text_parallel(FileView *view, LoadBuffer *buffer, int workers);
+int valid_binary_name(const char *name, size_t len);
+int parse_binary(FileView *view, LoadBuffer *buffer);
 int load_file(char *filename, Student *students_head);
+int parse_point_changes(FileView *view, Student **heads, int lists, PointChange **changes,
+	int *count);
+int batch_update(char *filename, Student **heads, int lists);
+long long monotonic_ns(void);
+long long monotonic_ms(void);
+int sync_file(FILE *file);
+int sync_dir(const char *path);
+int journal_sync(Journal *journal);
+int journal_tick(Journal *journal);
+int journal_compact(Student *students_head);
+int journal_rotate(Journal *journal, Student *students_head);
+int journal_record(Student *students_head, char command, const char *student_id,
+	const char *arg1, const char *arg2);
+int read_binary_epoch(const char *filename, unsigned long *epoch);
+int journal_replay(Student *students_head, const char *path, unsigned long epoch);
+int journal_open(Student *students_head, const char *path);
+void journal_close(Journal *journal);
+int count_error(int err_code);
+void stats_flush(void);
+void record_command(char command, long long elapsed_ns, int err);
+void print_stats(FILE *stream, Student **heads, int lists);
 int run(char *input, Student *students_head);
+int run_command(char *input, Student *students_head, FILE *stream);
+int run_command_on(char *input, Student **heads, int lists, FILE *stream);
+int error_index(int err_code);
 void print_error(int err_code);
+void print_error_to(FILE *stream, int err_code);
+int line_reader_init(LineReader *reader, FILE *stream);
+char *read_line(LineReader *reader);
+void line_reader_free(LineReader *reader);
+int stdin_is_tty(void);
+int run_interactive(Student *students_head);
+int run_batch(Student *students_head);
+#ifdef __linux__
+int is_query(char command);
+int query_ready(Student *students_head, char command);
+int server_open(Server *server, Student *students_head, const char *path, int shard_count);
+void server_close(Server *server);
+void server_enqueue(Server *server, Client *client);
+Client *server_dequeue(Server *server);
+int server_accept(Server *server);
+void client_close(Server *server, Client *client);
+int client_receive(Client *client);
+int client_flush(Client *client);
+int client_run_input(Server *server, Client *client, int hung_up);
+void server_lock_all(Server *server, int exclusive);
+void server_unlock_all(Server *server);
+int server_run_locked(Shard *shard, char *line, FILE *stream);
+int shard_run(Shard *shard, char *line, FILE *stream, int exclusive);
+int server_run_update(Server *server, char *line, FILE *stream);
+int server_run_query(Server *server, char *line, FILE *stream);
+int server_run_snapshot(Server *server, char *line, FILE *stream);
+void batch_shards(Server *server, const char *line, int *affected);
+int server_run_batch(Server *server, char *line, FILE *stream);
+int server_run_resharded(Server *server, char *line, FILE *stream);
+Shard *shard_of_line(Server *server, const char *line);
+int server_run_line(Server *server, char *line, FILE *stream);
+Snapshot *shard_snapshot(Shard *shard, int copy, int *err);
+void *snapshot_job(void *arg);
+int snapshot_acquire(Server *server, Snapshot **snapshots);
+void snapshot_release(Shard *shard, Snapshot *snapshot);
+void snapshot_free(Snapshot *snapshot);
+void server_serve(Server *server, Client *client);
+void *server_worker(void *arg);
+void server_stop_signal(int sig);
+int run_server(Student *students_head, const char *path, int shard_count);
+#endif
 
 #endif //! _PROJECT__H_
\ No newline at end of file
@@ -0,0 +1,7 @@
+O students.txt
+B points.txt
+L
+B bad_points.txt
+L
+R aa0007
+Q
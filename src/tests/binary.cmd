@@ -0,0 +1,9 @@
+O students.txt
+W copy.sdb
+A cc0001 Uusi Opiskelija
+O copy.sdb
+L
+W copy.txt
+O copy.txt
+L
+Q
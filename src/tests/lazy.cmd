@@ -0,0 +1,14 @@
+A bb0001 Laine Olli
+A bb0002 Heikkinen Aada
+U bb0002 3 12
+A bb0003 Laine Aarne
+U bb0001 1 12
+T 2
+R bb0003
+P 1 20
+N Lai
+L
+U bb0003 2 30
+R bb0003
+L
+Q
@@ -0,0 +1,10 @@
+O students.txt
+T 3
+R aa0005
+R aa0004
+P 30 50
+P 60 60
+N Virt
+N Ko
+T 100
+Q